@@ -0,0 +1,279 @@
+// Micro-benchmarks of the vmath and geometry hot paths, built by
+// scons bench and run as ./jaster_bench [name filter].
+//
+// Every benchmark works over the same fixed, generated input and keeps the
+// fastest of several runs. Output is one tab separated line per benchmark
+// after a header: name, items per run, ns per item, million items per second.
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "../src/math/vmath.h"
+#include "../src/math/common.h"
+#include "../src/math/precision.h"
+#include "../src/geometry/frustum.h"
+#include "../src/geometry/plane.h"
+#include "../src/geometry/transform.h"
+#include "../src/geometry/viewport.h"
+
+namespace
+{
+	// Large enough to leave the L1 cache, small enough for L2
+	const size_t xcItems = 1 << 14;
+	const int xcRuns = 50;
+	
+	const char* xFilter = nullptr;
+	
+	// Results are summed in here so the work can't be optimized away
+	volatile double xSink = 0.0;
+	
+	// Fixed seed, the input is the same on every run and machine
+	class Random
+	{
+	public:
+		Random() : mState(0x9e3779b9u) {}
+		
+		// Uniform in [min, max)
+		double next(double min, double max)
+		{
+			// xorshift32
+			mState ^= mState << 13;
+			mState ^= mState >> 17;
+			mState ^= mState << 5;
+			return min + (max - min) * (mState / 4294967296.0);
+		}
+		
+		Vector3d nextVector(double min, double max)
+		{
+			double x = next(min, max);
+			double y = next(min, max);
+			return Vector3d(x, y, next(min, max));
+		}
+		
+		Quatd nextRotation()
+		{
+			Vector3d axis = nextVector(-1.0, 1.0);
+			axis.normalize();
+			return Quatd::fromAxisRot(axis, (float)next(0.0, 360.0));
+		}
+		
+	private:
+		uint32_t mState;
+	};
+	
+	// Times func, which processes items items per call
+	template<typename TFunc>
+	void run(const char* name, size_t items, TFunc func)
+	{
+		if (xFilter && !std::strstr(name, xFilter))
+		{
+			return;
+		}
+		
+		// One untimed run to warm the caches
+		xSink = xSink + func();
+		
+		double best = std::numeric_limits<double>::infinity();
+		for (int i = 0; i < xcRuns; i++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			xSink = xSink + func();
+			std::chrono::duration<double, std::nano> time = std::chrono::steady_clock::now() - start;
+			best = std::min(best, time.count());
+		}
+		
+		double nsPerItem = best / items;
+		std::printf("%s\t%zu\t%.3f\t%.2f\n", name, items, nsPerItem, 1e3 / nsPerItem);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 1)
+	{
+		xFilter = argv[1];
+	}
+	
+	Random random;
+	
+	std::vector<Vector4d> points(xcItems);
+	std::vector<Vector4f> pointsf(xcItems);
+	std::vector<Vector3d> vectors(xcItems);
+	std::vector<Vector3r> pointsr(xcItems);
+	std::vector<Matrix4d> matrices(xcItems);
+	std::vector<Quatd> rotations(xcItems);
+	std::vector<Triangle3d> triangles(xcItems);
+	Vector3Arrayr pointArray;
+	pointArray.resize(xcItems);
+	
+	for (size_t i = 0; i < xcItems; i++)
+	{
+		Vector3d p = random.nextVector(-100.0, 100.0);
+		points[i] = Vector4d(p, 1.0);
+		pointsf[i] = Vector4f(Vector3f(p), 1.0f);
+		vectors[i] = random.nextVector(-1.0, 1.0);
+		pointsr[i] = Vector3r(p);
+		pointArray.set(i, pointsr[i]);
+		
+		rotations[i] = random.nextRotation();
+		matrices[i] = Transform(random.nextVector(-10.0, 10.0), rotations[i]).getMatrix();
+		
+		triangles[i].p0 = p;
+		triangles[i].p1 = p + random.nextVector(-1.0, 1.0);
+		triangles[i].p2 = p + random.nextVector(-1.0, 1.0);
+		triangles[i].n0 = triangles[i].n1 = triangles[i].n2 = vectors[i];
+	}
+	
+	const Matrix4d transform = matrices[0];
+	const Matrix4f transformf = transform;
+	const Plane3d plane(Vector3d(1.0, 2.0, 3.0), Vector3d(0.0, 1.0, 0.0));
+	
+	Frustum frustum(90.0, 2.0, 1.0, 1000.0);
+	frustum.getTransform().setPosition(Vector3d(0.0, 0.0, 200.0));
+	const Viewport viewport(1024, 512);
+	
+	std::vector<Vector4d> outPoints(xcItems);
+	std::vector<Vector4f> outPointsf(xcItems);
+	std::vector<Vector3d> outVectors(xcItems);
+	std::vector<Vector3r> outPointsr(xcItems);
+	std::vector<Matrix4d> outMatrices(xcItems);
+	std::vector<Triangle3d> outTriangles(xcItems);
+	Vector3Arrayr outPointArray;
+	
+	std::printf("name\titems\tns_per_item\tmitems_per_s\n");
+	
+	run("matrix4d_mul_vector4d", xcItems, [&]()
+	{
+		for (size_t i = 0; i < xcItems; i++)
+		{
+			outPoints[i] = transform * points[i];
+		}
+		return outPoints[xcItems / 2].x;
+	});
+	
+	run("matrix4f_mul_vector4f", xcItems, [&]()
+	{
+		for (size_t i = 0; i < xcItems; i++)
+		{
+			outPointsf[i] = transformf * pointsf[i];
+		}
+		return (double)outPointsf[xcItems / 2].x;
+	});
+	
+	run("matrix4d_mul_matrix4d", xcItems, [&]()
+	{
+		for (size_t i = 0; i < xcItems; i++)
+		{
+			outMatrices[i] = transform * matrices[i];
+		}
+		return outMatrices[xcItems / 2].at(3, 0);
+	});
+	
+	run("matrix4d_inverse_rigid", xcItems, [&]()
+	{
+		for (size_t i = 0; i < xcItems; i++)
+		{
+			outMatrices[i] = matrices[i].inverse(MatrixKind::Rigid);
+		}
+		return outMatrices[xcItems / 2].at(3, 0);
+	});
+	
+	run("matrix4d_inverse_general", xcItems, [&]()
+	{
+		for (size_t i = 0; i < xcItems; i++)
+		{
+			outMatrices[i] = matrices[i].inverse();
+		}
+		return outMatrices[xcItems / 2].at(3, 0);
+	});
+	
+	run("quatd_rotate", xcItems, [&]()
+	{
+		for (size_t i = 0; i < xcItems; i++)
+		{
+			outVectors[i] = rotations[i].rotate(vectors[i]);
+		}
+		return outVectors[xcItems / 2].x;
+	});
+	
+	run("vector3d_normalize", xcItems, [&]()
+	{
+		for (size_t i = 0; i < xcItems; i++)
+		{
+			outVectors[i] = vectors[i];
+			outVectors[i].normalize();
+		}
+		return outVectors[xcItems / 2].x;
+	});
+	
+	run("plane3d_signed_distance", xcItems, [&]()
+	{
+		double sum = 0.0;
+		for (size_t i = 0; i < xcItems; i++)
+		{
+			sum += plane.signedDistance(vectors[i]);
+		}
+		return sum;
+	});
+	
+	run("frustum_project_point", xcItems, [&]()
+	{
+		for (size_t i = 0; i < xcItems; i++)
+		{
+			outVectors[i] = frustum.project(vectors[i] * 100.0);
+		}
+		return outVectors[xcItems / 2].x;
+	});
+	
+	run("frustum_project_array", xcItems, [&]()
+	{
+		frustum.project(pointsr.data(), outPointsr.data(), xcItems);
+		return (double)outPointsr[xcItems / 2].x;
+	});
+	
+	run("frustum_project_soa", xcItems, [&]()
+	{
+		frustum.project(pointArray, outPointArray);
+		return (double)outPointArray.x[xcItems / 2];
+	});
+	
+	run("frustum_ndc_to_viewport", xcItems, [&]()
+	{
+		for (size_t i = 0; i < xcItems; i++)
+		{
+			outPointsr[i] = frustum.ndcToViewportSpace(pointsr[i], viewport);
+		}
+		return (double)outPointsr[xcItems / 2].x;
+	});
+	
+	run("math_transform_point", xcItems, [&]()
+	{
+		for (size_t i = 0; i < xcItems; i++)
+		{
+			outVectors[i] = math::transform(transform, points[i]);
+		}
+		return outVectors[xcItems / 2].x;
+	});
+	
+	run("math_transform_triangle", xcItems, [&]()
+	{
+		for (size_t i = 0; i < xcItems; i++)
+		{
+			math::transform(outTriangles[i], transform, triangles[i]);
+		}
+		return outTriangles[xcItems / 2].p0.x;
+	});
+	
+	run("math_transform_points_soa", xcItems, [&]()
+	{
+		math::transformPoints(outPointArray, Matrix4r(transform), pointArray);
+		return (double)outPointArray.x[xcItems / 2];
+	});
+	
+	// Keeps the sink alive, not part of the results
+	std::fprintf(stderr, "checksum %g\n", (double)xSink);
+	return 0;
+}
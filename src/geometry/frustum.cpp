@@ -1,10 +1,26 @@
 #include "frustum.h"
+#include <algorithm>
+
+namespace
+{
+	// Fixed point x and y stay within this many pixels of the origin, so
+	// edge functions of any two vertices fit in 64 bits
+	const TReal xcGuardBand = (TReal)(1 << 20);
+	
+	// Clamped before converting, NaN ends up at min
+	int toFixed(TReal value, TReal min, TReal max, TReal one)
+	{
+		return (int)std::lround(std::min(std::max(min, value), max) * one);
+	}
+}
 
 Frustum::Frustum(double fovY, double aspect, double near, double far) :
 	mFovY(fovY),
 	mAspect(aspect),
 	mNear(near),
-	mFar(far)
+	mFar(far),
+	mDirty(true),
+	mVersion(0)
 {
 	projectionChanged();
 }
@@ -20,10 +36,35 @@ void Frustum::setProjectionParams(double fovY, double aspect, double near, doubl
 
 void Frustum::projectionChanged()
 {
+	mTanHalfFovY = tan( mFovY / 360.0 * M_PI );
+	
 	double h = getHalfNearHeight();
 	double w = getHalfNearWidth();
 	
 	mProjection = Matrix4d::createFrustum(-w, w, -h, h, mNear, mFar);
+	mDirty = true;
+}
+
+void Frustum::update() const
+{
+	if (!mDirty && mVersion == mTransform.getVersion())
+	{
+		return;
+	}
+	
+	const Matrix4d view = mTransform.getInverse().getMatrix();
+	mViewProjection = mProjection * view;
+	mViewProjectionReal = mViewProjection;
+	updatePlanes();
+	
+	mVersion = mTransform.getVersion();
+	mDirty = false;
+}
+
+const Matrix4d& Frustum::getViewProjection() const
+{
+	update();
+	return mViewProjection;
 }
 
 double Frustum::getNearWidth() const
@@ -32,7 +73,7 @@ double Frustum::getNearWidth() const
 }
 double Frustum::getNearHeight() const
 {
-	return tan( mFovY / 360.0 * M_PI ) * mNear * 2.0;
+	return mTanHalfFovY * mNear * 2.0;
 }
 
 double Frustum::getHalfNearWidth() const
@@ -41,7 +82,7 @@ double Frustum::getHalfNearWidth() const
 }
 double Frustum::getHalfNearHeight() const
 {
-	return tan( mFovY / 360.0 * M_PI ) * mNear;
+	return mTanHalfFovY * mNear;
 }
 
 double Frustum::getFarWidth() const
@@ -50,7 +91,7 @@ double Frustum::getFarWidth() const
 }
 double Frustum::getFarHeight() const
 {
-	return tan( mFovY / 360.0 * M_PI ) * mFar * 2.0;
+	return mTanHalfFovY * mFar * 2.0;
 }
 double Frustum::getHalfFarWidth() const
 {
@@ -58,33 +99,58 @@ double Frustum::getHalfFarWidth() const
 }
 double Frustum::getHalfFarHeight() const
 {
-	return tan( mFovY / 360.0 * M_PI ) * mFar;
+	return mTanHalfFovY * mFar;
 }
 
 Vector3d Frustum::project(const Vector3d& p) const
 {
-	// From world to local coordinate system
-	Vector3d local = mTransform.globalToLocal(p);
+	// From world straight to clip space
+	Vector4d proj = getViewProjection() * Vector4d(p, 1.0);
 	
-	// Get homogeneous projection onto near plane
-	Vector4d proj = mProjection * Vector4d(local, 1.0);
-	
-	// Return normal device coordinates 
-	return proj.xyz() / proj.w;
+	// Return normal device coordinates (xyz() does the perspective divide)
+	return proj.xyz();
+}
+
+void Frustum::project(const Vector3r* in, Vector3r* out, size_t count) const
+{
+	update();
+	const Matrix4r& m = mViewProjectionReal;
+	for (size_t i = 0; i < count; i++)
+	{
+		out[i] = (m * Vector4r(in[i], (TReal)1)).xyz();
+	}
+}
+
+void Frustum::project(const Vector3Arrayr& in, Vector3Arrayr& out) const
+{
+	update();
+	math::projectPoints(out, mViewProjectionReal, in);
 }
 
-Vector3d Frustum::ndcToViewportSpace(const Vector3d& ndc, const Viewport& viewport) const
+Vector3r Frustum::ndcToViewportSpace(const Vector3r& ndc, const Viewport& viewport) const
 {
-	double halfWidth = viewport.getWidth() / 2.0;
-	double halfHeight = viewport.getHeight() / 2.0;
-	double fn = (viewport.getDepthFar() - viewport.getDepthNear()) / 2.0;
-	double nf = (viewport.getDepthNear() - viewport.getDepthFar()) / 2.0;
+	TReal halfWidth = viewport.getWidth() / 2;
+	TReal halfHeight = viewport.getHeight() / 2;
+	TReal fn = (viewport.getDepthFar() - viewport.getDepthNear()) / 2;
+	TReal nf = (viewport.getDepthNear() + viewport.getDepthFar()) / 2;
 	
-	return Vector3d(ndc.x * halfWidth + (viewport.getX() + halfWidth), 
+	// Depth is mapped to [depthNear, depthFar], near plane ends up at depthNear
+	return Vector3r(ndc.x * halfWidth + (viewport.getX() + halfWidth), 
 					ndc.y * halfHeight + (viewport.getY() + halfHeight),
 					ndc.z * fn + nf);
 }
 
+Vector3i Frustum::ndcToFixedViewportSpace(const Vector3r& ndc, const Viewport& viewport) const
+{
+	const Vector3r screen = ndcToViewportSpace(ndc, viewport);
+	const TReal depth = (screen.z - viewport.getDepthNear()) / (viewport.getDepthFar() - viewport.getDepthNear());
+	
+	const TReal one = (TReal)(1 << xcSubpixelBits);
+	return Vector3i(toFixed(screen.x, -xcGuardBand, xcGuardBand, one),
+					toFixed(screen.y, -xcGuardBand, xcGuardBand, one),
+					toFixed(depth, 0, 1, (TReal)(1 << xcFixedDepthBits)));
+}
+
 bool Frustum::ndcContained(const Vector3d& ndc, double epsilon)
 {
 	double pos = 1.0 + epsilon;
@@ -102,68 +168,108 @@ bool Frustum::contains(const Vector3d& p) const
 // Project NDC to line in global space
 // Line unProject(double x, double y) const;
 
-// Expressed in global coordinates
-Plane Frustum::getNearPlane() const
+Frustum::Containment Frustum::classify(const Vector3d& center, double radius) const
 {
-	const Vector3d& pos = mTransform.getPosition();
-	const Vector3d& at = mTransform.getAt();
-	return Plane(pos + at * mNear, -at);
-}
-Plane Frustum::getFarPlane() const
-{
-	const Vector3d& pos = mTransform.getPosition();
-	const Vector3d& at = mTransform.getAt();
-	return Plane(pos + at * mNear, at);
-}
-Plane Frustum::getLeftPlane() const
-{
-	Vector3d left = -mTransform.getRight() * getHalfNearWidth();
-	Vector3d leftSide = mTransform.getAt() + left;
-	Vector3d normal = mTransform.getUp().crossProduct(leftSide);
-	return Plane(mTransform.getPosition(), normal);
+	update();
+	
+	Containment result = Containment::Inside;
+	for (const auto& plane : mPlanes)
+	{
+		double dist = plane.signedDistance(center);
+		if (dist < -radius)
+		{
+			return Containment::Outside;
+		}
+		if (dist < radius)
+		{
+			result = Containment::Intersects;
+		}
+	}
+	return result;
 }
-Plane Frustum::getRightPlane() const
+
+Frustum::Containment Frustum::classify(const Aabb3d& box) const
 {
-	Vector3d right = mTransform.getRight() * getHalfNearWidth();
-	Vector3d rightSide = mTransform.getAt() + right;
-	Vector3d normal = rightSide.crossProduct(mTransform.getUp());
-	return Plane(mTransform.getPosition(), normal);
+	update();
+	
+	Containment result = Containment::Inside;
+	for (const auto& plane : mPlanes)
+	{
+		const Vector3d& n = plane.getNormal();
+		
+		// Corners furthest along and against the normal
+		Vector3d pos(n.x >= 0.0 ? box.max.x : box.min.x,
+					 n.y >= 0.0 ? box.max.y : box.min.y,
+					 n.z >= 0.0 ? box.max.z : box.min.z);
+		Vector3d neg(n.x >= 0.0 ? box.min.x : box.max.x,
+					 n.y >= 0.0 ? box.min.y : box.max.y,
+					 n.z >= 0.0 ? box.min.z : box.max.z);
+		
+		if (plane.signedDistance(pos) < 0.0)
+		{
+			return Containment::Outside;
+		}
+		if (plane.signedDistance(neg) < 0.0)
+		{
+			result = Containment::Intersects;
+		}
+	}
+	return result;
 }
-Plane Frustum::getTopPlane() const
+
+// Expressed in global coordinates
+void Frustum::getPlanes(Plane3d planes[6]) const
 {
-	Vector3d top = mTransform.getUp() * getHalfNearHeight();
-	Vector3d topSide = mTransform.getAt() + top;
-	Vector3d normal = topSide.crossProduct(-mTransform.getRight());
-	return Plane(mTransform.getPosition(), normal);
+	update();
+	for (int i = 0; i < 6; i++)
+	{
+		planes[i] = mPlanes[i];
+	}
 }
-Plane Frustum::getBottomPlane() const
+Plane3d Frustum::getNearPlane() const { update(); return mPlanes[0]; }
+Plane3d Frustum::getFarPlane() const { update(); return mPlanes[1]; }
+Plane3d Frustum::getLeftPlane() const { update(); return mPlanes[2]; }
+Plane3d Frustum::getRightPlane() const { update(); return mPlanes[3]; }
+Plane3d Frustum::getTopPlane() const { update(); return mPlanes[4]; }
+Plane3d Frustum::getBottomPlane() const { update(); return mPlanes[5]; }
+
+void Frustum::updatePlanes() const
 {
-	Vector3d bottom = -mTransform.getUp() * getHalfNearHeight();
-	Vector3d bottomSide = mTransform.getAt() + bottom;
-	Vector3d normal = bottomSide.crossProduct(mTransform.getRight());
-	return Plane(mTransform.getPosition(), normal);
+	const Vector3d& pos = mTransform.getPosition();
+	const Vector3d forward = getForward();
+	const Vector3d right = mTransform.getRight();
+	const Vector3d up = mTransform.getUp();
+	
+	const Vector3d nearCenter = forward * mNear;
+	const Vector3d side = right * getHalfNearWidth();
+	const Vector3d vertical = up * getHalfNearHeight();
+	
+	mPlanes[0] = Plane3d(pos + nearCenter, forward);
+	mPlanes[1] = Plane3d(pos + forward * mFar, -forward);
+	mPlanes[2] = Plane3d(pos, (nearCenter - side).crossProduct(up));
+	mPlanes[3] = Plane3d(pos, up.crossProduct(nearCenter + side));
+	mPlanes[4] = Plane3d(pos, (nearCenter + vertical).crossProduct(right));
+	mPlanes[5] = Plane3d(pos, right.crossProduct(nearCenter - vertical));
 }
 
 // These methods have the input rages [-1, 1]
 Vector3d Frustum::getNearPos(double x, double y) const
 {
 	const Vector3d& pos = mTransform.getPosition();
-	const Vector3d& at = mTransform.getAt();
 	const Vector3d& right = mTransform.getRight();
 	const Vector3d& up = mTransform.getUp();
 	
-	const Vector3d center = pos + at * mNear;
+	const Vector3d center = pos + getForward() * mNear;
 	const Vector3d weight = right * x * getHalfNearWidth() + up * y * getHalfNearHeight();
 	return center + weight;
 }
 Vector3d Frustum::getFarPos(double x, double y) const
 {
 	const Vector3d& pos = mTransform.getPosition();
-	const Vector3d& at = mTransform.getAt();
 	const Vector3d& right = mTransform.getRight();
 	const Vector3d& up = mTransform.getUp();
 	
-	const Vector3d center = pos + at * mFar;
+	const Vector3d center = pos + getForward() * mFar;
 	const Vector3d weight = right * x * getHalfFarWidth() + up * y * getHalfFarHeight();
 	return center + weight;
 }
@@ -5,6 +5,8 @@
 #include "transform.h"
 #include "viewport.h"
 #include "../math/vmath.h"
+#include "../math/precision.h"
+#include "../math/common.h"
 
 // Does not support orthogonal projection
 class Frustum
@@ -22,10 +24,22 @@ public:
 	
 	// Project point p in global space to normal device coordinates (NDC)
 	Vector3d project(const Vector3d& p) const;
+	// Project count points at once, in and out may be the same array.
+	// Runs in the pipeline precision, for vertices.
+	void project(const Vector3r* in, Vector3r* out, size_t count) const;
+	// Same for streams of points, see math::projectPoints
+	void project(const Vector3Arrayr& in, Vector3Arrayr& out) const;
+	
+	// From global space to clip space, projection * view
+	const Matrix4d& getViewProjection() const;
 	// Project NDC to line in global space
 	// Line unProject(double x, double y) const;
 	
-	Vector3d ndcToViewportSpace(const Vector3d& ndc, const Viewport& viewport) const;
+	Vector3r ndcToViewportSpace(const Vector3r& ndc, const Viewport& viewport) const;
+	// Same, snapped to the fixed point screen space of math/precision.h.
+	// x and y are clamped to a guard band of 2^20 pixels, depth saturates
+	// at the ends of the viewport's depth range.
+	Vector3i ndcToFixedViewportSpace(const Vector3r& ndc, const Viewport& viewport) const;
 	
 	// Normal device coordinates ([-1, 1]) contained within frustum
 	static bool ndcContained(const Vector3d& ndc, double epsilon = 1e-3);
@@ -33,6 +47,20 @@ public:
 	// Primitives contained completely within this frustum
 	bool contains(const Vector3d& p) const;
 	
+	enum class Containment
+	{
+		Outside,
+		Intersects,
+		Inside
+	};
+	
+	// Test bounding volumes in global space against the six planes
+	Containment classify(const Vector3d& center, double radius) const;
+	Containment classify(const Aabb3d& box) const;
+	
+	double getNear() const { return mNear; }
+	double getFar() const { return mFar; }
+	
 	// Get width of rectangles
 	double getNearWidth() const;
 	double getNearHeight() const;
@@ -44,13 +72,14 @@ public:
 	double getHalfFarWidth() const;
 	double getHalfFarHeight() const;
 	
-	// Expressed in global coordinates
-	Plane getNearPlane() const;
-	Plane getFarPlane() const;
-	Plane getLeftPlane() const;
-	Plane getRightPlane() const;
-	Plane getTopPlane() const;
-	Plane getBottomPlane() const;
+	// Expressed in global coordinates, normals point into the frustum
+	void getPlanes(Plane3d planes[6]) const;
+	Plane3d getNearPlane() const;
+	Plane3d getFarPlane() const;
+	Plane3d getLeftPlane() const;
+	Plane3d getRightPlane() const;
+	Plane3d getTopPlane() const;
+	Plane3d getBottomPlane() const;
 	
 	// These methods have the input rages [-1, 1]
 	Vector3d getNearPos(double x, double y) const;
@@ -63,10 +92,25 @@ public:
 private:
 	void projectionChanged();
 	
+	// Rebuild the view-projection and planes if the transform moved
+	void update() const;
+	void updatePlanes() const;
+	
+	// The frustum looks down its local negative z-axis
+	Vector3d getForward() const { return -mTransform.getAt(); }
+	
 	double mFovY, mAspect, mNear, mFar;
+	double mTanHalfFovY;
 	Transform mTransform;
 	Matrix4d mProjection;
 	
+	// Derived from mTransform, valid while mVersion matches it
+	mutable bool mDirty;
+	mutable unsigned mVersion;
+	mutable Matrix4d mViewProjection;
+	mutable Matrix4r mViewProjectionReal;	// Same, for project()
+	mutable Plane3d mPlanes[6];
+
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,72 @@
+#include "hierarchy.h"
+#include <algorithm>
+
+TransformHierarchy::TransformHierarchy() :
+	mFirstDirty(0)
+{
+}
+
+TransformHierarchy::TNodeId TransformHierarchy::add(const Transform& local, TNodeId parent)
+{
+	TNodeId id = (TNodeId)mParents.size();
+	
+	mParents.push_back(parent);
+	mLocal.push_back(local);
+	mLocalMatrices.push_back(Matrix4d());
+	mWorldMatrices.push_back(Matrix4d());
+	mFlags.push_back(LocalDirty | WorldDirty);
+	
+	mFirstDirty = std::min(mFirstDirty, id);
+	return id;
+}
+
+void TransformHierarchy::setLocal(TNodeId id, const Transform& local)
+{
+	mLocal[id] = local;
+	mFlags[id] |= LocalDirty | WorldDirty;
+	mFirstDirty = std::min(mFirstDirty, id);
+}
+
+void TransformHierarchy::update()
+{
+	std::vector<TNodeId> changed;
+	update(changed);
+}
+
+void TransformHierarchy::update(std::vector<TNodeId>& changed)
+{
+	const TNodeId count = getNodeCount();
+	for (TNodeId id = mFirstDirty; id < count; id++)
+	{
+		unsigned char flags = mFlags[id];
+		const TNodeId parent = mParents[id];
+		
+		// Parents come first, a recomputed parent is already flagged
+		if (parent >= 0 && (mFlags[parent] & WorldDirty))
+		{
+			flags |= WorldDirty;
+		}
+		
+		if (!(flags & WorldDirty))
+		{
+			continue;
+		}
+		
+		if (flags & LocalDirty)
+		{
+			mLocalMatrices[id] = mLocal[id].getMatrix();
+		}
+		
+		mWorldMatrices[id] = parent >= 0 ? mWorldMatrices[parent] * mLocalMatrices[id] : mLocalMatrices[id];
+		changed.push_back(id);
+		
+		// Kept until the pass is done so children see it
+		mFlags[id] = WorldDirty;
+	}
+	
+	for (TNodeId id = mFirstDirty; id < count; id++)
+	{
+		mFlags[id] = 0;
+	}
+	mFirstDirty = count;
+}
@@ -0,0 +1,56 @@
+#ifndef HIERARCHY_H
+#define HIERARCHY_H
+
+#include <vector>
+
+#include "transform.h"
+#include "../math/vmath.h"
+
+// Tree of transforms with cached local and world matrices. Nodes live in
+// flat arrays where parents always precede their children, so update()
+// is a single linear pass that only recomputes dirty nodes and the
+// subtrees below them.
+class TransformHierarchy
+{
+public:
+	using TNodeId = int;
+	
+	TransformHierarchy();
+	
+	// parent must already exist, or be -1 for a root
+	TNodeId add(const Transform& local, TNodeId parent = -1);
+	
+	int getNodeCount() const { return (int)mParents.size(); }
+	TNodeId getParent(TNodeId id) const { return mParents[id]; }
+	
+	// Relative to the parent
+	void setLocal(TNodeId id, const Transform& local);
+	const Transform& getLocal(TNodeId id) const { return mLocal[id]; }
+	const Matrix4d& getLocalMatrix(TNodeId id) const { return mLocalMatrices[id]; }
+	
+	// Valid after update(): parent world * local
+	const Matrix4d& getWorldMatrix(TNodeId id) const { return mWorldMatrices[id]; }
+	
+	// Recompute the matrices of dirty nodes and everything below them.
+	// changed receives the nodes whose world matrix was recomputed.
+	void update();
+	void update(std::vector<TNodeId>& changed);
+
+private:
+	enum
+	{
+		LocalDirty = 1,	// Local transform changed
+		WorldDirty = 2	// World matrix needs to be recomputed
+	};
+	
+	std::vector<TNodeId> mParents;
+	std::vector<Transform> mLocal;
+	std::vector<Matrix4d> mLocalMatrices;
+	std::vector<Matrix4d> mWorldMatrices;
+	std::vector<unsigned char> mFlags;
+	
+	// No node before this one is dirty
+	TNodeId mFirstDirty;
+};
+
+#endif
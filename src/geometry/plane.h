@@ -4,12 +4,20 @@
 #include <cstdint>
 #include "../math/vmath.h"
 
-class Plane
+template<typename T>
+class Plane3
 {
 public:
-	using TVec3 = Vector3d;
+	using TVec3 = Vector3<T>;
 	
-	Plane(const TVec3& pt, const TVec3& normal) :
+	Plane3() :
+		mNormal(0.0, 0.0, 1.0),
+		mPoint(0.0, 0.0, 0.0),
+		mD(0.0)
+	{
+	}
+	
+	Plane3(const TVec3& pt, const TVec3& normal) :
 		mNormal(normal),
 		mPoint(pt)
 	{
@@ -19,19 +27,22 @@ public:
 	// Construct plane from three points.
 	// Order matters; right hand rule can be
 	// used to determine the direction of the normal
-	Plane(const TVec3& p0, const TVec3& p1, const TVec3& p2) :
+	Plane3(const TVec3& p0, const TVec3& p1, const TVec3& p2) :
 		mNormal((p1 - p0).crossProduct(p2 - p1)),
 		mPoint(p0)
 	{
 		construct();
 	}
 	
-	double signedDistance(const TVec3& point)
+	T signedDistance(const TVec3& point) const
 	{
 		// Since the plane is always kept in hessian normal form.
 		return mNormal.dotProduct(point) + mD;
 	}
 	
+	const TVec3& getNormal() const { return mNormal; }
+	T getD() const { return mD; }
+	
 private:
 	void construct()
 	{
@@ -42,7 +53,10 @@ private:
 	// normal.x * x + normal.y * y + normal.z * z = -d
 	TVec3 mNormal;
 	TVec3 mPoint;
-	double mD;
+	T mD;
 };
 
+typedef Plane3<float> Plane3f;
+typedef Plane3<double> Plane3d;
+
 #endif
\ No newline at end of file
@@ -1,18 +1,24 @@
 #ifndef TRANSFORM_H
 #define TRANSFORM_H
 
+#include "../math/vmath.h"
+
 class Transform
 {
 public:
 	Transform() :
 		mPos(0.0, 0.0, 0.0),
-		mRot(1.0, 0.0, 0.0, 0.0)
+		mRot(1.0, 0.0, 0.0, 0.0),
+		mRotMatrix(mRot.rotMatrix()),
+		mVersion(nextVersion())
 	{
 		
 	}
 	Transform(const Vector3d& pos, const Quatd& rot) :
 		mPos(pos),
-		mRot(rot)
+		mRot(rot),
+		mRotMatrix(mRot.rotMatrix()),
+		mVersion(nextVersion())
 	{	
 	}
 	
@@ -21,10 +27,12 @@ public:
 	{
 		mRot = rot * mRot;
 		mRot.normalize();
+		rotationChanged();
 	}
 	void setRotation(const Quatd& rot)
 	{
 		mRot = rot;
+		rotationChanged();
 	}
 	const Quatd& getRotation() const
 	{
@@ -34,11 +42,13 @@ public:
 	void translate(const Vector3d& translate)
 	{
 		mPos += translate;
+		mVersion = nextVersion();
 	}
 	
 	void setPosition(const Vector3d& pos)
 	{
 		mPos = pos;
+		mVersion = nextVersion();
 	}
 	
 	const Vector3d& getPosition() const
@@ -46,51 +56,109 @@ public:
 		return mPos;
 	}
 	
+	// Changes on every modification, lets owners cache derived data.
+	// Versions are unique across instances, so assigning another
+	// transform is detected as well.
+	unsigned getVersion() const
+	{
+		return mVersion;
+	}
+	
+	// Rotation as a matrix, kept in sync with the quaternion
+	const Matrix3d& getRotationMatrix() const
+	{
+		return mRotMatrix;
+	}
+	
+	// Local axes are the columns of the rotation matrix
 	Vector3d getRight() const
 	{
-		return mRot.rotate(Vector3d(1.0, 0.0, 0.0));
+		return Vector3d(mRotMatrix.at(0, 0), mRotMatrix.at(0, 1), mRotMatrix.at(0, 2));
 	}
 	
 	Vector3d getUp() const
 	{
-		return mRot.rotate(Vector3d(0.0, 1.0, 0.0));
+		return Vector3d(mRotMatrix.at(1, 0), mRotMatrix.at(1, 1), mRotMatrix.at(1, 2));
 	}
 	
 	Vector3d getAt() const
 	{
-		return mRot.rotate(Vector3d(0.0, 0.0, 1.0));
+		return Vector3d(mRotMatrix.at(2, 0), mRotMatrix.at(2, 1), mRotMatrix.at(2, 2));
+	}
+	
+	// Same as: T * R
+	Matrix4d getMatrix() const
+	{
+		Matrix4d ret;
+		for (int col = 0; col < 3; col++)
+		{
+			for (int row = 0; row < 3; row++)
+			{
+				ret.at(col, row) = mRotMatrix.at(col, row);
+			}
+		}
+		ret.setTranslation(mPos);
+		return ret;
 	}
 	
+	// Inverse of T * R is R^T * T(-pos), R^T from the cached matrix
 	Transform getInverse() const
 	{
-		return Transform(-mPos, ~mRot);
+		return Transform(globalToLocal(Vector3d(0.0, 0.0, 0.0)), ~mRot);
 	}
 	
 	// Go from a point expressed in local coordinates 
 	// to a point in the global reference frame
 	Vector3d localToGlobal(const Vector3d& v) const
 	{
-		return mRot.rotate(v) + mPos;
+		return mRotMatrix * v + mPos;
 	}
 	
+	// The inverse rotation is the transpose
 	Vector3d globalToLocal(const Vector3d& v) const
 	{
-		return mRot.inverseRotate(v - mPos);
+		const Vector3d d = v - mPos;
+		const double* m = mRotMatrix.data;
+		return Vector3d(m[0] * d.x + m[1] * d.y + m[2] * d.z,
+						m[3] * d.x + m[4] * d.y + m[5] * d.z,
+						m[6] * d.x + m[7] * d.y + m[8] * d.z);
 	}
 	
 	// The same as: T * R * rhs.T * rhs.R
-	Transform& operator*(const Transform& rhs)
+	Transform operator*(const Transform& rhs) const
 	{
-		mPos += mRot.rotate(rhs.mPos);
+		Quatd rot = mRot * rhs.mRot;
+		rot.normalize();
+		return Transform(mPos + mRotMatrix * rhs.mPos, rot);
+	}
+	
+	Transform& operator*=(const Transform& rhs)
+	{
+		mPos += mRotMatrix * rhs.mPos;
 		mRot = mRot * rhs.mRot;
 		
 		mRot.normalize();
+		rotationChanged();
 		return *this;
 	}
 	
 private:
+	void rotationChanged()
+	{
+		mRotMatrix = mRot.rotMatrix();
+		mVersion = nextVersion();
+	}
+	
+	static unsigned nextVersion()
+	{
+		static unsigned counter = 0;
+		return ++counter;
+	}
+	
 	Vector3d mPos;
 	Quatd mRot;
+	Matrix3d mRotMatrix;
+	unsigned mVersion;
 };
 
 #endif
\ No newline at end of file
@@ -1,10 +1,12 @@
 #ifndef VIEWPORT_H
 #define VIEWPORT_H
 
+#include "../math/precision.h"
+
 class Viewport
 {
 public:
-	Viewport(double width, double height) :
+	Viewport(TReal width, TReal height) :
 		mWidth(width),
 		mHeight(height),
 		mDepthNear(0.0),
@@ -14,14 +16,14 @@ public:
 	{
 	}
 	
-	double getWidth() const { return mWidth; }
-	double getHeight() const { return mHeight; }
-	double getDepthNear() const { return mDepthNear; }
-	double getDepthFar() const { return mDepthFar; }
-	double getX() const { return mX; }
-	double getY() const { return mY; }
+	TReal getWidth() const { return mWidth; }
+	TReal getHeight() const { return mHeight; }
+	TReal getDepthNear() const { return mDepthNear; }
+	TReal getDepthFar() const { return mDepthFar; }
+	TReal getX() const { return mX; }
+	TReal getY() const { return mY; }
 private:
-	double mWidth, mHeight, mDepthNear, mDepthFar, mX, mY;
+	TReal mWidth, mHeight, mDepthNear, mDepthFar, mX, mY;
 };
 
 #endif
\ No newline at end of file
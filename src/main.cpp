@@ -2,6 +2,9 @@
 #include <SDL/SDL.h>
 #include "window.h"
 #include "Renderer.h"
+#include "shadowmap.h"
+#include "scene.h"
+#include "meshlod.h"
 #include "tiny_obj_loader.h"
 #include "geometry/transform.h"
 
@@ -9,18 +12,29 @@ namespace {
 
 	const int xcWinWidth = 1024;
 	const int xcWinHeight = 512;
+	const int xcShadowMapSize = 512;
+	
+	// Objects smaller than this on screen (in pixels) are shaded per 2x2 block
+	const double xcCoarseShadingSize = 64.0;
+	
 	std::shared_ptr<Window> xWindow = nullptr;
 	std::shared_ptr<Renderer> xRenderer = nullptr;
 	
-	std::vector<Triangle3d> dragonMesh;
+	Mesh dragonMesh;
+	MeshLod dragonLod;
 	
-	Vector3d unmarshalVector(int idx, const std::vector<float>& data)
+	Vector3d unmarshalVector(int idx, const float* data)
 	{
 		return Vector3d((double)data[3*idx+0],
 						(double)data[3*idx+1],
 						(double)data[3*idx+2]);
 	}
 	
+	Vector3d unmarshalVector(int idx, const std::vector<float>& data)
+	{
+		return unmarshalVector(idx, data.data());
+	}
+	
 	Vector3d generateNormal(const Vector3d& p0, const Vector3d& p1, const Vector3d& p2)
 	{
 		Vector3d vec = (p1-p0).crossProduct(p2-p1);
@@ -28,7 +42,7 @@ namespace {
 		return vec;
 	}
 	
-	void loadObjFile(std::vector<Triangle3d>& mesh, const std::string& file)
+	void loadObjFile(Mesh& mesh, const std::string& file)
 	{
 		std::cout << "Loading \"" << file << "..." << std::endl;
 		
@@ -46,11 +60,25 @@ namespace {
 		std::cout << "-> shapes    : " << shapes.size() << std::endl;
 		std::cout << "-> materials : " << materials.size() << std::endl;
 		
+		std::cout << "Converting materials..." << std::endl;
+		
+		for (const auto& mat : materials)
+		{
+			Material material;
+			material.name = mat.name;
+			material.ambient = unmarshalVector(0, mat.ambient);
+			material.diffuse = unmarshalVector(0, mat.diffuse);
+			material.specular = unmarshalVector(0, mat.specular);
+			material.shininess = mat.shininess;
+			mesh.materials.push_back(material);
+		}
+		
 		std::cout << "Converting triangles..." << std::endl;
 		
-		for (auto shape : shapes)
+		std::vector<int> triMaterials;
+		for (const auto& shape : shapes)
 		{
-			Triangle3d tri;
+			Triangle3r tri;
 			for (int i = 0; i < shape.mesh.indices.size() / 3; i++)
 			{
 				int idx = shape.mesh.indices[3*i+0];
@@ -70,24 +98,98 @@ namespace {
 					tri.n0 = tri.n1 = tri.n2 = generateNormal(tri.p0, tri.p1, tri.p2);
 				}
 								  
-				mesh.push_back(tri);
+				mesh.triangles.push_back(tri);
+				triMaterials.push_back((size_t)i < shape.mesh.material_ids.size() ? shape.mesh.material_ids[i] : -1);
 			}
 		}
 		
-		std::cout << "-> triangles: " << mesh.size() << std::endl;
+		mesh.groupByMaterial(triMaterials);
+		mesh.buildMeshlets();
+		mesh.updateBounds();
+		
+		std::cout << "-> triangles: " << mesh.triangles.size() << std::endl;
+		std::cout << "-> meshlets : " << mesh.meshlets.size() << std::endl;
 		std::cout << "Success!" << std::endl;
 	}
 	
-	void renderMesh(const std::vector<Triangle3d>& mesh, const Matrix4d& transform)
+	std::vector<Scene::TObjectId> xVisible;
+	std::vector<Scene::TObjectId> xCasters;
+	std::vector<Scene::TObjectId> xReached;
+	
+	// Indices of the lights reaching each object, by object id
+	std::vector<std::vector<size_t>> xObjectLights;
+	
+	// One BVH query per light instead of testing every light per object
+	void selectLights(Scene& scene)
 	{
-		Triangle3d global;
-		for (auto tri : mesh)
+		xObjectLights.resize(scene.getObjectCount());
+		for (auto id : xVisible)
 		{
-			math::transform(global, transform, tri);
-			xRenderer->renderTriangle(global);
+			xObjectLights[id].clear();
+		}
+		
+		const auto& lights = xRenderer->getLightContext()->lights;
+		for (size_t i = 0; i < lights.size(); i++)
+		{
+			if (lights[i].getRadius() == std::numeric_limits<double>::infinity())
+			{
+				for (auto id : xVisible)
+				{
+					xObjectLights[id].push_back(i);
+				}
+				continue;
+			}
+			
+			xReached.clear();
+			scene.query(lights[i].pos, lights[i].getRadius(), xReached);
+			for (auto id : xReached)
+			{
+				xObjectLights[id].push_back(i);
+			}
 		}
 	}
 	
+	void renderScene(Scene& scene)
+	{
+		// Detail levels are picked for the camera, shadows reuse them
+		xVisible.clear();
+		scene.cull(*xRenderer->getCamera(), xVisible);
+		for (auto id : xVisible)
+		{
+			scene.selectLod(id, xRenderer->getScreenSize(scene.getObject(id).bounds));
+		}
+		
+		for (const auto& light : xRenderer->getLightContext()->lights)
+		{
+			if (light.shadowMap)
+			{
+				light.shadowMap->clear();
+				
+				xCasters.clear();
+				scene.cull(light.shadowMap->getFrustum(), xCasters);
+				for (auto id : xCasters)
+				{
+					const SceneObject& object = scene.getObject(id);
+					xRenderer->renderShadowMesh(*light.shadowMap, object.getMesh(), object.getMatrix());
+				}
+			}
+		}
+		
+		selectLights(scene);
+		for (auto id : xVisible)
+		{
+			const SceneObject& object = scene.getObject(id);
+			const bool distant = xRenderer->getScreenSize(object.bounds) < xcCoarseShadingSize;
+			
+			MeshInstance instance;
+			instance.transform = object.getMatrix();
+			instance.lights = &xObjectLights[id];
+			xRenderer->submitInstanced(object.getMesh(), &instance, 1, 0,
+									   distant ? ShadingRate::Rate2x2 : ShadingRate::Rate1x1);
+		}
+		xRenderer->flush();
+	}
+	
 	Vector2i xKeyDir;
 
 	void handleKeyboard(const SDL_Event& event)
@@ -151,17 +253,31 @@ int main(int argc, char** argv)
 	std::cout << "Loading model files..." << std::endl;
 	loadObjFile(dragonMesh, "obj/cow.obj");
 	
+	std::cout << "Generating detail levels..." << std::endl;
+	dragonLod.generate(dragonMesh);
+	for (int i = 0; i < dragonLod.getLevelCount(); i++)
+	{
+		std::cout << "-> level " << i << ": " << dragonLod.getLevel(i).triangles.size() << " triangles" << std::endl;
+	}
+	
 	std::cout << "Initializing SDL..." << std::endl;
 	SDL_Init(SDL_INIT_EVERYTHING);
 	
 	std::cout << "Initializing renderer..." << std::endl;
 	xWindow = std::make_shared<Window>(xcWinWidth, xcWinHeight);
 	xRenderer = std::make_shared<Renderer>(xWindow);
+	xRenderer->setOcclusionCulling(true);
+	
+	for (auto& light : xRenderer->getLightContext()->lights)
+	{
+		light.shadowMap = std::make_shared<ShadowMap>(xcShadowMapSize, xcShadowMapSize, 90.0, 1.0, 1000.0);
+		light.shadowMap->lookAt(light.pos, Vector3d(0.0, 0.0, -100.0));
+	}
+	
+	Scene scene;
+	Scene::TObjectId cow = scene.add(dragonLod, Transform(Vector3d(0.0, 0.0, -100.0), Quatd(1.0, 0.0, 0.0, 0.0)), 10.0);
 	
-	Matrix4d scale = Matrix4d::createScale(10, 10, 10);
-	Matrix4d translate = Matrix4d::createTranslation(0.0, 0.0, -100.0);
-	Matrix4d rotationStep = Matrix4d::createRotationAroundAxis(0.0, 180.0 / 25, 0.0);
-	Matrix4d rotation, transform;
+	const Quatd rotationStep = Quatd::fromAxisRot(Vector3d(0.0, 1.0, 0.0), 180.0 / 25);
 	
 	SDL_Event event;
 	bool quit = false;
@@ -173,12 +289,12 @@ int main(int argc, char** argv)
 		
 		uint32_t currentTimeMs = SDL_GetTicks();
 		
-		translate = Matrix4d::createTranslation(std::sin(currentTimeMs / 1000.0)*100.0, 0.0, -100.0);
-	
-		rotation = rotationStep * rotation;
-		transform = translate * rotation * scale;
-	
-		renderMesh(dragonMesh, transform);
+		Transform transform = scene.getTransform(cow);
+		transform.setPosition(Vector3d(std::sin(currentTimeMs / 1000.0)*100.0, 0.0, -100.0));
+		transform.rotate(rotationStep);
+		scene.setTransform(cow, transform);
+		
+		renderScene(scene);
 	
 		xWindow->blit();
 		
@@ -0,0 +1,29 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <string>
+
+#include "math/vmath.h"
+
+struct Material
+{
+	Material() :
+		ambient(1.0, 1.0, 1.0),
+		diffuse(1.0, 1.0, 1.0),
+		specular(1.0, 1.0, 1.0),
+		shininess(0.2)
+	{
+	}
+	
+	std::string name;
+	
+	// Reflectance, multiplied with the light colors
+	Vector3d ambient;
+	Vector3d diffuse;
+	Vector3d specular;
+	
+	// Specular exponent
+	double shininess;
+};
+
+#endif
@@ -0,0 +1,45 @@
+#include "color.h"
+
+namespace
+{
+	// Lookup resolution, 12 bits keeps every 8-bit sRGB level reachable
+	const int xcLutMax = 4095;
+	
+	struct SrgbLut
+	{
+		uint8_t table[xcLutMax + 1];
+		
+		SrgbLut()
+		{
+			for (int i = 0; i <= xcLutMax; i++)
+			{
+				double c = i / (double)xcLutMax;
+				double s = c <= 0.0031308 ? c * 12.92 : 1.055 * std::pow(c, 1.0 / 2.4) - 0.055;
+				table[i] = (uint8_t)(s * 255.0 + 0.5);
+			}
+		}
+	};
+	
+	const SrgbLut xSrgbLut;
+	
+	inline uint32_t lookup(double c)
+	{
+		// Clamp and round to a table index, NaN ends up at 0
+		c *= xcLutMax;
+		int idx = !(c > 0.0) ? 0 : (c >= xcLutMax ? xcLutMax : (int)(c + 0.5));
+		return xSrgbLut.table[idx];
+	}
+}
+
+uint32_t math::linearToSrgb(const Vector3d& color)
+{
+	return lookup(color.r) << 16 | lookup(color.g) << 8 | lookup(color.b);
+}
+
+void math::linearToSrgb(const Vector3d* colors, uint32_t* packed, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		packed[i] = lookup(colors[i].r) << 16 | lookup(colors[i].g) << 8 | lookup(colors[i].b);
+	}
+}
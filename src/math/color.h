@@ -0,0 +1,17 @@
+#ifndef COLOR_H
+#define COLOR_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vmath.h"
+
+namespace math
+{
+	// Convert linear colors to packed 8-bit sRGB (0xRRGGBB).
+	// Components are clamped to [0, 1] as part of the conversion.
+	uint32_t linearToSrgb(const Vector3d& color);
+	void linearToSrgb(const Vector3d* colors, uint32_t* packed, size_t count);
+}
+
+#endif
@@ -1,30 +1,330 @@
 #include "common.h"
+#include <algorithm>
 
 Vector3d math::transform(const Matrix4d& transform, const Vector4d& pt)
 {
 	return (transform * pt).xyz();
 }
 
-static inline Vector4d point(const Vector3d& pt)
+template<typename T>
+static inline Vector3<T> point(const Matrix4<T>& transform, const Vector3<T>& pt)
 {
-	return Vector4d(pt.x, pt.y, pt.z, 1.0);
+	return (transform * Vector4<T>(pt.x, pt.y, pt.z, 1)).xyz();
 }
 
-static inline Vector4d vect(const Vector3d& pt)
+template<typename T>
+static inline Vector3<T> vect(const Matrix4<T>& transform, const Vector3<T>& pt)
 {
-	return Vector4d(pt.x, pt.y, pt.z, 0.0);
+	return (transform * Vector4<T>(pt.x, pt.y, pt.z, 0)).xyz();
+}
+
+template<typename T>
+static inline void transformTriangle(Triangle3<T>& out, const Matrix4<T>& transform, const Triangle3<T>& tri)
+{
+	out.p0 = point(transform, tri.p0);
+	out.n0 = vect(transform, tri.n0);
+	
+	out.p1 = point(transform, tri.p1);
+	out.n1 = vect(transform, tri.n1);
+	
+	out.p2 = point(transform, tri.p2);
+	out.n2 = vect(transform, tri.n2);
+}
+
+void math::transform(Triangle3f& out, const Matrix4f& transform, const Triangle3f& tri)
+{
+	transformTriangle(out, transform, tri);
 }
 
 void math::transform(Triangle3d& out, const Matrix4d& transform, const Triangle3d& tri)
 {
-	out.p0 = math::transform(transform, point(tri.p0));
-	out.n0 = math::transform(transform, vect(tri.n0));
+	transformTriangle(out, transform, tri);
+}
+
+namespace
+{
+	enum class StreamOp
+	{
+		Points,
+		Normals,
+		Project
+	};
 	
-	out.p1 = math::transform(transform, point(tri.p1));
-	out.n1 = math::transform(transform, vect(tri.n1));
+	// One row of m * (x, y, z, w), m in column major order
+	template<typename T>
+	inline T row(const T* m, int r, T x, T y, T z, T w)
+	{
+		return m[r] * x + m[4 + r] * y + m[8 + r] * z + m[12 + r] * w;
+	}
 	
-	out.p2 = math::transform(transform, point(tri.p2));
-	out.n2 = math::transform(transform, vect(tri.n2));
+	// Scalar kernel, handles the tails left by the SIMD kernels
+	template<typename T>
+	void transformStreams(const T* m, StreamOp op, const T* x, const T* y, const T* z,
+						  T* outX, T* outY, T* outZ, size_t begin, size_t count)
+	{
+		const T w = op == StreamOp::Normals ? 0 : 1;
+		for (size_t i = begin; i < count; i++)
+		{
+			T tx = row(m, 0, x[i], y[i], z[i], w);
+			T ty = row(m, 1, x[i], y[i], z[i], w);
+			T tz = row(m, 2, x[i], y[i], z[i], w);
+			if (op == StreamOp::Project)
+			{
+				// As Vector4::xyz(), no divide at w = 0
+				T tw = row(m, 3, x[i], y[i], z[i], w);
+				T invW = tw == 0 ? 1 : 1 / tw;
+				tx *= invW;
+				ty *= invW;
+				tz *= invW;
+			}
+			outX[i] = tx;
+			outY[i] = ty;
+			outZ[i] = tz;
+		}
+	}
+
+#ifdef VMATH_SIMD
+	// Register types and operations of the SIMD kernel per scalar type
+	template<typename T>
+	struct Simd;
+
+#ifdef __AVX__
+	template<>
+	struct Simd<float>
+	{
+		typedef __m256 V;
+		static const size_t width = 8;
+		static V set(float a) { return _mm256_set1_ps(a); }
+		static V load(const float* p) { return _mm256_loadu_ps(p); }
+		static void store(float* p, V a) { _mm256_storeu_ps(p, a); }
+		static V add(V a, V b) { return _mm256_add_ps(a, b); }
+		static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+		static V div(V a, V b) { return _mm256_div_ps(a, b); }
+		// a where a != 0, b elsewhere
+		static V nonZeroOr(V a, V b)
+		{
+			V zero = _mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_EQ_OQ);
+			return _mm256_or_ps(_mm256_andnot_ps(zero, a), _mm256_and_ps(zero, b));
+		}
+	};
+
+	template<>
+	struct Simd<double>
+	{
+		typedef __m256d V;
+		static const size_t width = 4;
+		static V set(double a) { return _mm256_set1_pd(a); }
+		static V load(const double* p) { return _mm256_loadu_pd(p); }
+		static void store(double* p, V a) { _mm256_storeu_pd(p, a); }
+		static V add(V a, V b) { return _mm256_add_pd(a, b); }
+		static V mul(V a, V b) { return _mm256_mul_pd(a, b); }
+		static V div(V a, V b) { return _mm256_div_pd(a, b); }
+		static V nonZeroOr(V a, V b)
+		{
+			V zero = _mm256_cmp_pd(a, _mm256_setzero_pd(), _CMP_EQ_OQ);
+			return _mm256_or_pd(_mm256_andnot_pd(zero, a), _mm256_and_pd(zero, b));
+		}
+	};
+#else
+	template<>
+	struct Simd<float>
+	{
+		typedef __m128 V;
+		static const size_t width = 4;
+		static V set(float a) { return _mm_set1_ps(a); }
+		static V load(const float* p) { return _mm_loadu_ps(p); }
+		static void store(float* p, V a) { _mm_storeu_ps(p, a); }
+		static V add(V a, V b) { return _mm_add_ps(a, b); }
+		static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+		static V div(V a, V b) { return _mm_div_ps(a, b); }
+		static V nonZeroOr(V a, V b)
+		{
+			V zero = _mm_cmpeq_ps(a, _mm_setzero_ps());
+			return _mm_or_ps(_mm_andnot_ps(zero, a), _mm_and_ps(zero, b));
+		}
+	};
+
+	template<>
+	struct Simd<double>
+	{
+		typedef __m128d V;
+		static const size_t width = 2;
+		static V set(double a) { return _mm_set1_pd(a); }
+		static V load(const double* p) { return _mm_loadu_pd(p); }
+		static void store(double* p, V a) { _mm_storeu_pd(p, a); }
+		static V add(V a, V b) { return _mm_add_pd(a, b); }
+		static V mul(V a, V b) { return _mm_mul_pd(a, b); }
+		static V div(V a, V b) { return _mm_div_pd(a, b); }
+		static V nonZeroOr(V a, V b)
+		{
+			V zero = _mm_cmpeq_pd(a, _mm_setzero_pd());
+			return _mm_or_pd(_mm_andnot_pd(zero, a), _mm_and_pd(zero, b));
+		}
+	};
+#endif
+
+	// Transforms width vectors per step, returns how many were done
+	template<typename T>
+	size_t transformStreamsSimd(const T* m, StreamOp op, const T* x, const T* y, const T* z,
+								T* outX, T* outY, T* outZ, size_t count)
+	{
+		typedef Simd<T> S;
+		typedef typename S::V V;
+		
+		// Broadcast the matrix once, cols[c][r] holds m(c, r)
+		V cols[4][4];
+		for (int c = 0; c < 4; c++)
+		{
+			for (int r = 0; r < 4; r++)
+			{
+				cols[c][r] = S::set(m[c * 4 + r]);
+			}
+		}
+		
+		const V one = S::set(1);
+		const V w = op == StreamOp::Normals ? S::set(0) : one;
+		auto rowOf = [&](int r, V vx, V vy, V vz)
+		{
+			return S::add(S::add(S::add(S::mul(cols[0][r], vx), S::mul(cols[1][r], vy)),
+								 S::mul(cols[2][r], vz)), S::mul(cols[3][r], w));
+		};
+		
+		size_t i = 0;
+		for (; i + S::width <= count; i += S::width)
+		{
+			V vx = S::load(x + i);
+			V vy = S::load(y + i);
+			V vz = S::load(z + i);
+			
+			V tx = rowOf(0, vx, vy, vz);
+			V ty = rowOf(1, vx, vy, vz);
+			V tz = rowOf(2, vx, vy, vz);
+			if (op == StreamOp::Project)
+			{
+				V invW = S::div(one, S::nonZeroOr(rowOf(3, vx, vy, vz), one));
+				tx = S::mul(tx, invW);
+				ty = S::mul(ty, invW);
+				tz = S::mul(tz, invW);
+			}
+			
+			S::store(outX + i, tx);
+			S::store(outY + i, ty);
+			S::store(outZ + i, tz);
+		}
+		return i;
+	}
+#endif
+
+	template<typename T>
+	void transformArray(Vector3Array<T>& out, const Matrix4<T>& transform, const Vector3Array<T>& in, StreamOp op)
+	{
+		const size_t count = in.size();
+		out.resize(count);
+		if (count == 0)
+		{
+			return;
+		}
+		
+		const T* m = transform.data;
+		const T* x = in.x.data();
+		const T* y = in.y.data();
+		const T* z = in.z.data();
+		T* outX = out.x.data();
+		T* outY = out.y.data();
+		T* outZ = out.z.data();
+		
+		size_t done = 0;
+#ifdef VMATH_SIMD
+		done = transformStreamsSimd(m, op, x, y, z, outX, outY, outZ, count);
+#endif
+		transformStreams(m, op, x, y, z, outX, outY, outZ, done, count);
+	}
+}
+
+void math::transformPoints(Vector3Arrayf& out, const Matrix4f& transform, const Vector3Arrayf& in)
+{
+	transformArray(out, transform, in, StreamOp::Points);
+}
+
+void math::transformPoints(Vector3Arrayd& out, const Matrix4d& transform, const Vector3Arrayd& in)
+{
+	transformArray(out, transform, in, StreamOp::Points);
+}
+
+void math::transformNormals(Vector3Arrayf& out, const Matrix4f& transform, const Vector3Arrayf& in)
+{
+	transformArray(out, transform, in, StreamOp::Normals);
+}
+
+void math::transformNormals(Vector3Arrayd& out, const Matrix4d& transform, const Vector3Arrayd& in)
+{
+	transformArray(out, transform, in, StreamOp::Normals);
+}
+
+void math::projectPoints(Vector3Arrayf& out, const Matrix4f& transform, const Vector3Arrayf& in)
+{
+	transformArray(out, transform, in, StreamOp::Project);
+}
+
+void math::projectPoints(Vector3Arrayd& out, const Matrix4d& transform, const Vector3Arrayd& in)
+{
+	transformArray(out, transform, in, StreamOp::Project);
+}
+
+double math::maxScale(const Matrix4d& transform)
+{
+	double sx = Vector3d(transform.at(0, 0), transform.at(0, 1), transform.at(0, 2)).lengthSq();
+	double sy = Vector3d(transform.at(1, 0), transform.at(1, 1), transform.at(1, 2)).lengthSq();
+	double sz = Vector3d(transform.at(2, 0), transform.at(2, 1), transform.at(2, 2)).lengthSq();
+	return std::sqrt(std::max(sx, std::max(sy, sz)));
+}
+
+bool math::isConformal(const Matrix4d& transform, double epsilon)
+{
+	const Vector3d x(transform.at(0, 0), transform.at(0, 1), transform.at(0, 2));
+	const Vector3d y(transform.at(1, 0), transform.at(1, 1), transform.at(1, 2));
+	const Vector3d z(transform.at(2, 0), transform.at(2, 1), transform.at(2, 2));
+	
+	// Equal axis lengths and right angles, relative to the scale
+	const double tolerance = epsilon * x.lengthSq();
+	return std::abs(y.lengthSq() - x.lengthSq()) <= tolerance &&
+		   std::abs(z.lengthSq() - x.lengthSq()) <= tolerance &&
+		   std::abs(x.dotProduct(y)) <= tolerance &&
+		   std::abs(x.dotProduct(z)) <= tolerance &&
+		   std::abs(y.dotProduct(z)) <= tolerance;
+}
+
+Matrix4d math::normalMatrix(const Matrix4d& transform)
+{
+	Matrix4d ret = transform.inverse(MatrixKind::Affine).transpose();
+	ret.at(0, 3) = ret.at(1, 3) = ret.at(2, 3) = 0.0;
+	return ret;
+}
+
+template<typename T>
+static void normalizeArray(Vector3Array<T>& vectors)
+{
+	for (size_t i = 0; i < vectors.size(); i++)
+	{
+		const T lengthSq = vectors.x[i] * vectors.x[i] + vectors.y[i] * vectors.y[i] + vectors.z[i] * vectors.z[i];
+		if (lengthSq > 0)
+		{
+			const T invLength = 1 / std::sqrt(lengthSq);
+			vectors.x[i] *= invLength;
+			vectors.y[i] *= invLength;
+			vectors.z[i] *= invLength;
+		}
+	}
+}
+
+void math::normalize(Vector3Arrayf& vectors)
+{
+	normalizeArray(vectors);
+}
+
+void math::normalize(Vector3Arrayd& vectors)
+{
+	normalizeArray(vectors);
 }
 
 void math::clamp(double& out, double min, double max)
@@ -49,4 +349,26 @@ void math::clamp(Vector3d& vec, double min, double max)
 Vector3d math::reflect(const Vector3d& d, const Vector3d& normal)
 {
 	return d - normal * 2*(d.dotProduct(normal));
+}
+
+double math::distanceSq(const Aabb3d& box, const Vector3d& pt)
+{
+	double distSq = 0.0;
+	for (int i = 0; i < 3; i++)
+	{
+		if (pt[i] < box.min[i])
+		{
+			distSq += (box.min[i] - pt[i]) * (box.min[i] - pt[i]);
+		}
+		else if (pt[i] > box.max[i])
+		{
+			distSq += (pt[i] - box.max[i]) * (pt[i] - box.max[i]);
+		}
+	}
+	return distSq;
+}
+
+bool math::intersects(const Aabb3d& box, const Vector3d& center, double radius)
+{
+	return distanceSq(box, center) <= radius * radius;
 }
\ No newline at end of file
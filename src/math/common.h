@@ -1,17 +1,37 @@
 #ifndef COMMON_H
 #define COMMON_H
 
+#include <cstddef>
+#include <vector>
+
 #include "vmath.h"
+#include "precision.h"
 
-struct Triangle3d
+template<typename T>
+struct Triangle3
 {
+	Triangle3() {}
+	
+	template<typename FromT>
+	Triangle3(const Triangle3<FromT>& src) :
+		p0(src.p0), p1(src.p1), p2(src.p2),
+		n0(src.n0), n1(src.n1), n2(src.n2)
+	{
+	}
+	
 	// Vert
-	Vector3d p0, p1, p2;
+	Vector3<T> p0, p1, p2;
 
 	// Normal
-	Vector3d n0, n1, n2;
+	Vector3<T> n0, n1, n2;
 };
 
+typedef Triangle3<float> Triangle3f;
+typedef Triangle3<double> Triangle3d;
+typedef Triangle3<TReal> Triangle3r;
+// Fixed point screen space, see precision.h
+typedef Triangle3<int> Triangle3i;
+
 template<typename T>
 struct Box2
 {
@@ -21,17 +41,93 @@ struct Box2
 typedef Box2<double> Box2d;
 typedef Box2<int> Box2i;
 
+// Vectors as structure of arrays, one stream per component,
+// for the batch kernels in math::
+template<typename T>
+struct Vector3Array
+{
+	std::vector<T> x, y, z;
+	
+	size_t size() const { return x.size(); }
+	
+	void resize(size_t count)
+	{
+		x.resize(count);
+		y.resize(count);
+		z.resize(count);
+	}
+	
+	void set(size_t i, const Vector3<T>& v)
+	{
+		x[i] = v.x;
+		y[i] = v.y;
+		z[i] = v.z;
+	}
+	
+	Vector3<T> get(size_t i) const { return Vector3<T>(x[i], y[i], z[i]); }
+};
+
+typedef Vector3Array<float> Vector3Arrayf;
+typedef Vector3Array<double> Vector3Arrayd;
+typedef Vector3Array<TReal> Vector3Arrayr;
+
 namespace math
 {
 	Vector3d transform(const Matrix4d& transform, const Vector4d& pt);
+	void transform(Triangle3f& out, const Matrix4f& transform, const Triangle3f& in);
 	void transform(Triangle3d& out, const Matrix4d& transform, const Triangle3d& in);
-
+	
+	// Batch kernels, out is resized to in and may be the same array.
+	// Products are summed in the same order as Matrix4 * Vector4.
+	// Points: transform * (p, 1)
+	void transformPoints(Vector3Arrayf& out, const Matrix4f& transform, const Vector3Arrayf& in);
+	void transformPoints(Vector3Arrayd& out, const Matrix4d& transform, const Vector3Arrayd& in);
+	// Normals and other directions: transform * (n, 0)
+	void transformNormals(Vector3Arrayf& out, const Matrix4f& transform, const Vector3Arrayf& in);
+	void transformNormals(Vector3Arrayd& out, const Matrix4d& transform, const Vector3Arrayd& in);
+	// Points to clip space and through the perspective divide, e.g. to NDC
+	void projectPoints(Vector3Arrayf& out, const Matrix4f& transform, const Vector3Arrayf& in);
+	void projectPoints(Vector3Arrayd& out, const Matrix4d& transform, const Vector3Arrayd& in);
+	
+	// Largest scale factor of the transform's axes, for transforming radii
+	double maxScale(const Matrix4d& transform);
+	
+	// Upper 3x3 is a rotation times a uniform scale, so it keeps angles and
+	// scales every direction by maxScale
+	bool isConformal(const Matrix4d& transform, double epsilon = 1e-9);
+	
+	// Inverse transpose of the upper 3x3 part, no translation. Transforms
+	// normals correctly under non-uniform scale, their length does change.
+	Matrix4d normalMatrix(const Matrix4d& transform);
+	
+	// Normalize every vector of the array
+	void normalize(Vector3Arrayf& vectors);
+	void normalize(Vector3Arrayd& vectors);
+	
 	void clamp(double& out, double min, double max);
 	// Clamp all components of the vector to min and max values.
 	void clamp(Vector3d& vec, double min, double max);
 	
 	// Normal must be normalized
 	Vector3d reflect(const Vector3d& d, const Vector3d& normal);
+	
+	// Squared distance from point to the closest point of the box, 0 if inside
+	double distanceSq(const Aabb3d& box, const Vector3d& pt);
+	
+	// Sphere and box overlap
+	bool intersects(const Aabb3d& box, const Vector3d& center, double radius);
+	
+	// Orders positions component by component, e.g. to weld vertices in a map
+	struct PositionLess
+	{
+		template<typename T>
+		bool operator()(const Vector3<T>& a, const Vector3<T>& b) const
+		{
+			if (a.x != b.x) return a.x < b.x;
+			if (a.y != b.y) return a.y < b.y;
+			return a.z < b.z;
+		}
+	};
 }
 
 #endif
\ No newline at end of file
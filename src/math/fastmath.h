@@ -0,0 +1,208 @@
+#ifndef FASTMATH_H
+#define FASTMATH_H
+
+#include <cstdint>
+#include <cstring>
+
+#include "vmath.h"
+
+// Fast approximations of the transcendental functions, in float. They are
+// branch free apart from selects, so loops over arrays vectorize. Error
+// bounds are against the double precision std functions.
+namespace math
+{
+	namespace fastmath_detail
+	{
+		inline float fromBits(uint32_t bits)
+		{
+			float f;
+			std::memcpy(&f, &bits, sizeof(f));
+			return f;
+		}
+		
+		inline uint32_t toBits(float f)
+		{
+			uint32_t bits;
+			std::memcpy(&bits, &f, sizeof(bits));
+			return bits;
+		}
+		
+		// sin and cos of r in [-pi/4, pi/4] (Cephes minimax polynomials)
+		inline float sinPoly(float r)
+		{
+			float z = r * r;
+			return ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z - 1.6666654611e-1f) * z * r + r;
+		}
+		
+		inline float cosPoly(float r)
+		{
+			float z = r * r;
+			return ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z + 4.166664568298827e-2f) * z * z -
+				   0.5f * z + 1.0f;
+		}
+		
+		// Flip the sign of x when flip is set, without a branch
+		inline float negateIf(float x, bool flip)
+		{
+			return fromBits(toBits(x) ^ ((uint32_t)flip << 31));
+		}
+		
+		// cond ? a : b on the bits, gcc branches on a plain select here
+		inline float select(bool cond, float a, float b)
+		{
+			uint32_t mask = 0u - (uint32_t)cond;
+			return fromBits((toBits(a) & mask) | (toBits(b) & ~mask));
+		}
+		
+		// Round to nearest for |x| < 2^22, unlike nearbyint this is inlined
+		// and vectorizes
+		inline float roundNearest(float x)
+		{
+			const float magic = 12582912.0f; // 1.5 * 2^23
+			return (x + magic) - magic;
+		}
+		
+		// x = k * pi / 2 + r, pi / 2 split in three parts so r stays exact
+		inline float reduceQuadrant(float x, int& k)
+		{
+			float fk = roundNearest(x * 0.63661977236758134f);
+			k = (int)fk;
+			return ((x - fk * 1.5703125f) - fk * 4.837512969970703125e-4f) - fk * 7.54978995489188216e-8f;
+		}
+	}
+	
+	// 1 / sqrt(x) from the SSE estimate and one Newton step, relative
+	// error below 1e-6. Plain 1 / sqrt(x) without SIMD.
+	inline float rsqrtFast(float x)
+	{
+#ifdef VMATH_SIMD
+		float y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+		return y * (1.5f - 0.5f * x * y * y);
+#else
+		return 1.0f / std::sqrt(x);
+#endif
+	}
+	
+	inline double rsqrtFast(double x)
+	{
+		// A second step in double, relative error below 1e-11
+		double y = rsqrtFast((float)x);
+		return y * (1.5 - 0.5 * x * y * y);
+	}
+	
+	// 2^x for |x| < 2^22, relative error below 3e-7. The exponent is clamped
+	// to [-126, 127], so results never turn denormal or infinite.
+	inline float exp2Fast(float x)
+	{
+		// 2^i * 2^f with f in [-0.5, 0.5], Taylor series of e^(f ln 2)
+		float i = fastmath_detail::roundNearest(x);
+		float f = x - i;
+		float p = 1.5403530393381606e-4f;
+		p = p * f + 1.3333558146428441e-3f;
+		p = p * f + 9.618129107628477e-3f;
+		p = p * f + 5.5504108664821576e-2f;
+		p = p * f + 2.402265069591007e-1f;
+		p = p * f + 6.931471805599453e-1f;
+		p = p * f + 1.0f;
+		
+		// Clamped as an integer, a float clamp of x makes gcc branch
+		int e = (int)i;
+		e = e < -126 ? -126 : e;
+		e = e > 127 ? 127 : e;
+		return p * fastmath_detail::fromBits((uint32_t)(e + 127) << 23);
+	}
+	
+	// log2(x) for normal x > 0, error below 2e-7 (relative once |log2 x| > 1).
+	// Zero and denormals give about -127, negative x garbage.
+	inline float log2Fast(float x)
+	{
+		// x = 2^e * m with m in [sqrt(1/2), sqrt(2)), the exponent is taken
+		// one higher when the mantissa is above sqrt(2)
+		uint32_t bits = fastmath_detail::toBits(x);
+		uint32_t mantissa = bits & 0x007fffff;
+		uint32_t high = mantissa > 0x003504f3 ? 1 : 0;
+		int e = (int)((bits >> 23) & 0xff) - 127 + (int)high;
+		float m = fastmath_detail::fromBits(mantissa | (0x3f800000 - (high << 23)));
+		
+		// log2(m) = 2 / ln 2 * atanh(t), odd series in t up to t^7
+		float t = (m - 1.0f) / (m + 1.0f);
+		float t2 = t * t;
+		float p = 4.121985831111324e-1f;
+		p = p * t2 + 5.770780163555853e-1f;
+		p = p * t2 + 9.617966939259756e-1f;
+		p = p * t2 + 2.8853900817779268f;
+		return (float)e + p * t;
+	}
+	
+	// x^y for x >= 0 as 2^(y log2 x). The error of log2 is scaled by
+	// y log2 x, the relative error is about 2.1e-7 * |y log2 x|: below 3.5e-6
+	// while |y log2 x| < 16, and below 2.7e-5 for integer y up to 256 until
+	// the result underflows. pow(0, y > 0) is below 1e-37.
+	inline float powFast(float x, float y)
+	{
+		return exp2Fast(y * log2Fast(x));
+	}
+	
+	// sin and cos with absolute error below 1e-7 for |x| < 1e4, the error of
+	// the argument reduction grows with |x| beyond that
+	inline float sinFast(float x)
+	{
+		int k;
+		float r = fastmath_detail::reduceQuadrant(x, k);
+		float s = fastmath_detail::sinPoly(r);
+		float c = fastmath_detail::cosPoly(r);
+		return fastmath_detail::negateIf(fastmath_detail::select((k & 1) != 0, c, s), (k & 2) != 0);
+	}
+	
+	inline float cosFast(float x)
+	{
+		// cos(x) = sin(x + pi / 2), one quadrant on
+		int k;
+		float r = fastmath_detail::reduceQuadrant(x, k);
+		k++;
+		float s = fastmath_detail::sinPoly(r);
+		float c = fastmath_detail::cosPoly(r);
+		return fastmath_detail::negateIf(fastmath_detail::select((k & 1) != 0, c, s), (k & 2) != 0);
+	}
+	
+	// tan with error below 2.2e-7 (relative once |tan x| > 1) for |x| <= 1.5.
+	// Near the poles the error of the argument reduction is amplified, up to
+	// 1e-6 for |x| < 10 and 4e-5 for |x| < 1e4.
+	inline float tanFast(float x)
+	{
+		int k;
+		float r = fastmath_detail::reduceQuadrant(x, k);
+		float s = fastmath_detail::sinPoly(r);
+		float c = fastmath_detail::cosPoly(r);
+		bool odd = (k & 1) != 0;
+		return fastmath_detail::negateIf(odd ? c : s, odd) / (odd ? s : c);
+	}
+	
+	// Math policies for shaders, written once against TMath::pow etc. and
+	// instantiated with either. Shaders compute in double.
+	struct PreciseMath
+	{
+		static double pow(double x, double y) { return std::pow(x, y); }
+		static double exp2(double x) { return std::exp2(x); }
+		static double log2(double x) { return std::log2(x); }
+		static double sqrt(double x) { return std::sqrt(x); }
+		static double sin(double x) { return std::sin(x); }
+		static double cos(double x) { return std::cos(x); }
+		static double tan(double x) { return std::tan(x); }
+		static void normalize(Vector3d& v) { v.normalize(); }
+	};
+	
+	struct FastMath
+	{
+		static double pow(double x, double y) { return powFast((float)x, (float)y); }
+		static double exp2(double x) { return exp2Fast((float)x); }
+		static double log2(double x) { return log2Fast((float)x); }
+		static double sqrt(double x) { return x > 0.0 ? x * rsqrtFast(x) : 0.0; }
+		static double sin(double x) { return sinFast((float)x); }
+		static double cos(double x) { return cosFast((float)x); }
+		static double tan(double x) { return tanFast((float)x); }
+		static void normalize(Vector3d& v) { v *= rsqrtFast(v.lengthSq()); }
+	};
+}
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef PRECISION_H
+#define PRECISION_H
+
+#include "vmath.h"
+
+// Scalar type of the per vertex and per pixel work: vertex buffers,
+// projection, depth and interpolants. float by default, define
+// JASTER_DOUBLE (scons precision=double) to validate against double.
+#ifdef JASTER_DOUBLE
+typedef double TReal;
+#else
+typedef float TReal;
+#endif
+
+typedef Vector2<TReal> Vector2r;
+typedef Vector3<TReal> Vector3r;
+typedef Vector4<TReal> Vector4r;
+typedef Matrix4<TReal> Matrix4r;
+
+// Screen space of the fixed point pipeline mode: x and y in pixels with
+// xcSubpixelBits fraction bits, z the viewport's depth range mapped to
+// [0, 2^xcFixedDepthBits]
+const int xcSubpixelBits = 8;
+const int xcFixedDepthBits = 24;
+
+#endif
@@ -128,6 +128,11 @@
 #include <string>
 #include <cassert>
 
+#if defined(__SSE2__) && !defined(VMATH_NO_SIMD)
+#define VMATH_SIMD
+#include <immintrin.h>
+#endif
+
 #ifdef VMATH_NAMESPACE
 namespace VMATH_NAMESPACE
 {
@@ -189,7 +194,7 @@ public:
 	/**
 	 * Creates and sets to (0,0)
 	 */
-	Vector2()
+	constexpr Vector2()
 			: x(0), y(0)
 	{
 	}
@@ -199,7 +204,7 @@ public:
 	 * @param nx initial x-coordinate value
 	 * @param ny initial y-coordinate value
 	 */
-	Vector2(T nx, T ny)
+	constexpr Vector2(T nx, T ny)
 			: x(nx), y(ny)
 	{
 	}
@@ -208,17 +213,14 @@ public:
 	 * Copy constructor.
 	 * @param src Source of data for new created instance.
 	 */
-	Vector2(const Vector2<T>& src)
-			: x(src.x), y(src.y)
-	{
-	}
+	Vector2(const Vector2<T>& src) = default;
 
 	/**
 	 * Copy casting constructor.
 	 * @param src Source of data for new created instance.
 	 */
 	template<class FromT>
-	Vector2(const Vector2<FromT>& src)
+	constexpr Vector2(const Vector2<FromT>& src)
 			: x(static_cast<T>(src.x)), y(static_cast<T>(src.y))
 	{
 	}
@@ -240,12 +242,7 @@ public:
 	 * Copy operator
 	 * @param rhs Right hand side argument of binary operator.
 	 */
-	Vector2<T>& operator=(const Vector2<T>& rhs)
-	{
-		x = rhs.x;
-		y = rhs.y;
-		return *this;
-	}
+	Vector2<T>& operator=(const Vector2<T>& rhs) = default;
 
 	/**
 	 * Array access operator
@@ -282,7 +279,7 @@ public:
 	 * Addition operator
 	 * @param rhs Right hand side argument of binary operator.
 	 */
-	Vector2<T> operator+(const Vector2<T>& rhs) const
+	constexpr Vector2<T> operator+(const Vector2<T>& rhs) const
 	{
 		return Vector2<T>(x + rhs.x, y + rhs.y);
 	}
@@ -291,7 +288,7 @@ public:
 	 * Subtraction operator
 	 * @param rhs Right hand side argument of binary operator.
 	 */
-	Vector2<T> operator-(const Vector2<T>& rhs) const
+	constexpr Vector2<T> operator-(const Vector2<T>& rhs) const
 	{
 		return Vector2<T>(x - rhs.x, y - rhs.y);
 	}
@@ -300,7 +297,7 @@ public:
 	 * Multiplication operator
 	 * @param rhs Right hand side argument of binary operator.
 	 */
-	Vector2<T> operator*(const Vector2<T>& rhs) const
+	constexpr Vector2<T> operator*(const Vector2<T>& rhs) const
 	{
 		return Vector2<T>(x * rhs.x, y * rhs.y);
 	}
@@ -309,7 +306,7 @@ public:
 	 * Division operator
 	 * @param rhs Right hand side argument of binary operator.
 	 */
-	Vector2<T> operator/(const Vector2<T>& rhs) const
+	constexpr Vector2<T> operator/(const Vector2<T>& rhs) const
 	{
 		return Vector2<T>(x / rhs.x, y / rhs.y);
 	}
@@ -363,7 +360,7 @@ public:
 	 * Addition operator
 	 * @param rhs Right hand side argument of binary operator.
 	 */
-	Vector2<T> operator+(T rhs) const
+	constexpr Vector2<T> operator+(T rhs) const
 	{
 		return Vector2<T>(x + rhs, y + rhs);
 	}
@@ -372,7 +369,7 @@ public:
 	 * Subtraction operator
 	 * @param rhs Right hand side argument of binary operator.
 	 */
-	Vector2<T> operator-(T rhs) const
+	constexpr Vector2<T> operator-(T rhs) const
 	{
 		return Vector2<T>(x - rhs, y - rhs);
 	}
@@ -381,7 +378,7 @@ public:
 	 * Multiplication operator
 	 * @param rhs Right hand side argument of binary operator.
 	 */
-	Vector2<T> operator*(T rhs) const
+	constexpr Vector2<T> operator*(T rhs) const
 	{
 		return Vector2<T>(x * rhs, y * rhs);
 	}
@@ -390,7 +387,7 @@ public:
 	 * Division operator
 	 * @param rhs Right hand side argument of binary operator.
 	 */
-	Vector2<T> operator/(T rhs) const
+	constexpr Vector2<T> operator/(T rhs) const
 	{
 		return Vector2<T>(x / rhs, y / rhs);
 	}
@@ -467,7 +464,7 @@ public:
 	 * Unary negate operator
 	 * @return negated vector
 	 */
-	Vector2<T> operator-() const
+	constexpr Vector2<T> operator-() const
 	{
 		return Vector2<T>(-x, -y);
 	}
@@ -499,7 +496,7 @@ public:
 	 * of length of two vector can be used just this value, instead
 	 * of more expensive length() method.
 	 */
-	T lengthSq() const
+	constexpr T lengthSq() const
 	{
 		return x * x + y * y;
 	}
@@ -650,7 +647,7 @@ public:
 	/**
 	 * Creates and sets to (0,0,0)
 	 */
-	Vector3()
+	constexpr Vector3()
 			: x(0), y(0), z(0)
 	{
 	}
@@ -661,7 +658,7 @@ public:
 	 * @param ny initial y-coordinate value
 	 * @param nz initial z-coordinate value
 	 */
-	Vector3(T nx, T ny, T nz)
+	constexpr Vector3(T nx, T ny, T nz)
 			: x(nx), y(ny), z(nz)
 	{
 	}
@@ -670,17 +667,14 @@ public:
 	 * Copy constructor.
 	 * @param src Source of data for new created Vector3 instance.
 	 */
-	Vector3(const Vector3<T>& src)
-			: x(src.x), y(src.y), z(src.z)
-	{
-	}
+	Vector3(const Vector3<T>& src) = default;
 
 	/**
 	 * Copy casting constructor.
 	 * @param src Source of data for new created Vector3 instance.
 	 */
 	template<class FromT>
-	Vector3(const Vector3<FromT>& src)
+	constexpr Vector3(const Vector3<FromT>& src)
 			: x(static_cast<T>(src.x)), y(static_cast<T>(src.y)), z(static_cast<T>(src.z))
 	{
 	}
@@ -690,13 +684,7 @@ public:
 	 * Copy operator
 	 * @param rhs Right hand side argument of binary operator.
 	 */
-	Vector3<T> operator=(const Vector3<T>& rhs)
-	{
-		x = rhs.x;
-		y = rhs.y;
-		z = rhs.z;
-		return *this;
-	}
+	Vector3<T>& operator=(const Vector3<T>& rhs) = default;
 
 	/**
 	 * Copy casting operator.
@@ -752,7 +740,7 @@ public:
 	 * Addition operator
 	 * @param rhs Right hand side argument of binary operator.
 	 */
-	Vector3<T> operator+(const Vector3<T>& rhs) const
+	constexpr Vector3<T> operator+(const Vector3<T>& rhs) const
 	{
 		return Vector3<T>(x + rhs.x, y + rhs.y, z + rhs.z);
 	}
@@ -761,7 +749,7 @@ public:
 	 * Subtraction operator
 	 * @param rhs Right hand side argument of binary operator.
 	 */
-	Vector3<T> operator-(const Vector3<T>& rhs) const
+	constexpr Vector3<T> operator-(const Vector3<T>& rhs) const
 	{
 		return Vector3<T>(x - rhs.x, y - rhs.y, z - rhs.z);
 	}
@@ -770,7 +758,7 @@ public:
 	 * Multiplication operator
 	 * @param rhs Right hand side argument of binary operator.
 	 */
-	Vector3<T> operator*(const Vector3<T>& rhs) const
+	constexpr Vector3<T> operator*(const Vector3<T>& rhs) const
 	{
 		return Vector3<T>(x * rhs.x, y * rhs.y, z * rhs.z);
 	}
@@ -779,7 +767,7 @@ public:
 	 * Division operator
 	 * @param rhs Right hand side argument of binary operator.
 	 */
-	Vector3<T> operator/(const Vector3<T>& rhs) const
+	constexpr Vector3<T> operator/(const Vector3<T>& rhs) const
 	{
 		return Vector3<T>(x / rhs.x, y / rhs.y, z / rhs.z);
 	}
@@ -836,7 +824,7 @@ public:
 	 * Dot product of two vectors.
 	 * @param rhs Right hand side argument of binary operator.
 	 */
-	T dotProduct(const Vector3<T>& rhs) const
+	constexpr T dotProduct(const Vector3<T>& rhs) const
 	{
 		return x * rhs.x + y * rhs.y + z * rhs.z;
 	}
@@ -845,7 +833,7 @@ public:
 	 * Cross product operator
 	 * @param rhs Right hand side argument of binary operator.
 	 */
-	Vector3<T> crossProduct(const Vector3<T>& rhs) const
+	constexpr Vector3<T> crossProduct(const Vector3<T>& rhs) const
 	{
 		return Vector3<T>(y * rhs.z - rhs.y * z, z * rhs.x - rhs.z * x, x * rhs.y - rhs.x * y);
 	}
@@ -855,7 +843,7 @@ public:
 	 * Addition operator
 	 * @param rhs Right hand side argument of binary operator.
 	 */
-	Vector3<T> operator+(T rhs) const
+	constexpr Vector3<T> operator+(T rhs) const
 	{
 		return Vector3<T>(x + rhs, y + rhs, z + rhs);
 	}
@@ -864,7 +852,7 @@ public:
 	 * Subtraction operator
 	 * @param rhs Right hand side argument of binary operator.
 	 */
-	Vector3<T> operator-(T rhs) const
+	constexpr Vector3<T> operator-(T rhs) const
 	{
 		return Vector3<T>(x - rhs, y - rhs, z - rhs);
 	}
@@ -873,7 +861,7 @@ public:
 	 * Multiplication operator
 	 * @param rhs Right hand side argument of binary operator.
 	 */
-	Vector3<T> operator*(T rhs) const
+	constexpr Vector3<T> operator*(T rhs) const
 	{
 		return Vector3<T>(x * rhs, y * rhs, z * rhs);
 	}
@@ -882,7 +870,7 @@ public:
 	 * Division operator
 	 * @param rhs Right hand side argument of binary operator.
 	 */
-	Vector3<T> operator/(T rhs) const
+	constexpr Vector3<T> operator/(T rhs) const
 	{
 		return Vector3<T>(x / rhs, y / rhs, z / rhs);
 	}
@@ -963,7 +951,7 @@ public:
 	 * Unary negate operator
 	 * @return negated vector
 	 */
-	Vector3<T> operator-() const
+	constexpr Vector3<T> operator-() const
 	{
 		return Vector3<T>(-x, -y, -z);
 	}
@@ -990,7 +978,7 @@ public:
 	 * of length of two vector can be used just this value, instead
 	 * of more expensive length() method.
 	 */
-	T lengthSq() const
+	constexpr T lengthSq() const
 	{
 		return x * x + y * y + z * z;
 	}
@@ -1109,7 +1097,7 @@ typedef Vector3<int> Vector3i;
  * </ul>
  */
 template<class T>
-class Vector4
+class alignas(16) Vector4
 {
 public:
 
@@ -1171,7 +1159,7 @@ public:
 	/**
 	 * Creates and sets to (0,0,0,0)
 	 */
-	Vector4()
+	constexpr Vector4()
 			: x(0), y(0), z(0), w(0)
 	{
 	}
@@ -1183,7 +1171,7 @@ public:
 	 * @param nz initial z-coordinate value (B)
 	 * @param nw initial w-coordinate value (Alpha)
 	 */
-	Vector4(T nx, T ny, T nz, T nw)
+	constexpr Vector4(T nx, T ny, T nz, T nw)
 			: x(nx), y(ny), z(nz), w(nw)
 	{
 	}
@@ -1192,27 +1180,24 @@ public:
 	 * Copy constructor.
 	 * @param src Source of data for new created Vector4 instance.
 	 */
-	Vector4(const Vector4<T>& src)
-			: x(src.x), y(src.y), z(src.z), w(src.w)
-	{
-	}
+	Vector4(const Vector4<T>& src) = default;
 
 	/**
 	 * Copy casting constructor.
 	 * @param src Source of data for new created Vector4 instance.
 	 */
 	template<class FromT>
-	Vector4(const Vector4<FromT>& src)
+	constexpr Vector4(const Vector4<FromT>& src)
 			: x(static_cast<T>(src.x)), y(static_cast<T>(src.y)), z(static_cast<T>(src.z)), w(static_cast<T>(src.w))
 	{
 	}
 
-	Vector4(const Vector3<T>& src, T w)
+	constexpr Vector4(const Vector3<T>& src, T w)
 		: x(src.x), y(src.y), z(src.z), w(w)
     {}
 
 	template <typename FromT>
-	Vector4(const Vector3<FromT>& src, FromT w)
+	constexpr Vector4(const Vector3<FromT>& src, FromT w)
 		: x(static_cast<T>(src.x)), y(static_cast<T>(src.y)), z(static_cast<T>(src.z)), w(static_cast<T>(w))
     {}
 
@@ -1221,14 +1206,7 @@ public:
 	 * Copy operator
 	 * @param rhs Right hand side argument of binary operator.
 	 */
-	Vector4<T> operator=(const Vector4<T>& rhs)
-	{
-		x = rhs.x;
-		y = rhs.y;
-		z = rhs.z;
-		w = rhs.w;
-		return *this;
-	}
+	Vector4<T>& operator=(const Vector4<T>& rhs) = default;
 
 	/**
 	 * Copy casting operator
@@ -1289,7 +1267,7 @@ public:
 	 * Addition operator
 	 * @param rhs Right hand side argument of binary operator.
 	 */
-	Vector4<T> operator+(const Vector4<T>& rhs) const
+	constexpr Vector4<T> operator+(const Vector4<T>& rhs) const
 	{
 		return Vector4<T>(x + rhs.x, y + rhs.y, z + rhs.z, w + rhs.w);
 	}
@@ -1298,7 +1276,7 @@ public:
 	 * Subtraction operator
 	 * @param rhs Right hand side argument of binary operator.
 	 */
-	Vector4<T> operator-(const Vector4<T>& rhs) const
+	constexpr Vector4<T> operator-(const Vector4<T>& rhs) const
 	{
 		return Vector4<T>(x - rhs.x, y - rhs.y, z - rhs.z, w - rhs.w);
 	}
@@ -1307,7 +1285,7 @@ public:
 	 * Multiplication operator
 	 * @param rhs Right hand side argument of binary operator.
 	 */
-	Vector4<T> operator*(const Vector4<T> rhs) const
+	constexpr Vector4<T> operator*(const Vector4<T> rhs) const
 	{
 		return Vector4<T>(x * rhs.x, y * rhs.y, z * rhs.z, w * rhs.w);
 	}
@@ -1316,7 +1294,7 @@ public:
 	 * Division operator
 	 * @param rhs Right hand side argument of binary operator.
 	 */
-	Vector4<T> operator/(const Vector4<T>& rhs) const
+	constexpr Vector4<T> operator/(const Vector4<T>& rhs) const
 	{
 		return Vector4<T>(x / rhs.x, y / rhs.y, z / rhs.z, w / rhs.w);
 	}
@@ -1402,7 +1380,7 @@ public:
 	 * Unary negate operator
 	 * @return negated vector
 	 */
-	Vector4<T> operator-() const
+	constexpr Vector4<T> operator-() const
 	{
 		return Vector4<T>(-x, -y, -z, -w);
 	}
@@ -1413,7 +1391,7 @@ public:
 	 * Addition operator
 	 * @param rhs Right hand side argument of binary operator.
 	 */
-	Vector4<T> operator+(T rhs) const
+	constexpr Vector4<T> operator+(T rhs) const
 	{
 		return Vector4<T>(x + rhs, y + rhs, z + rhs, w + rhs);
 	}
@@ -1422,7 +1400,7 @@ public:
 	 * Subtraction operator
 	 * @param rhs Right hand side argument of binary operator.
 	 */
-	Vector4<T> operator-(T rhs) const
+	constexpr Vector4<T> operator-(T rhs) const
 	{
 		return Vector4<T>(x - rhs, y - rhs, z - rhs, w - rhs);
 	}
@@ -1431,7 +1409,7 @@ public:
 	 * Multiplication operator
 	 * @param rhs Right hand side argument of binary operator.
 	 */
-	Vector4<T> operator*(T rhs) const
+	constexpr Vector4<T> operator*(T rhs) const
 	{
 		return Vector4<T>(x * rhs, y * rhs, z * rhs, w * rhs);
 	}
@@ -1440,7 +1418,7 @@ public:
 	 * Division operator
 	 * @param rhs Right hand side argument of binary operator.
 	 */
-	Vector4<T> operator/(T rhs) const
+	constexpr Vector4<T> operator/(T rhs) const
 	{
 		return Vector4<T>(x / rhs, y / rhs, z / rhs, w / rhs);
 	}
@@ -1531,6 +1509,24 @@ public:
 		return x * x + y * y + z * z + w * w;
 	}
 
+	/**
+	 * Dot product of all four components.
+	 * @param rhs Right hand side argument of binary operator.
+	 */
+	T dotProduct(const Vector4<T>& rhs) const
+	{
+		return x * rhs.x + y * rhs.y + z * rhs.z + w * rhs.w;
+	}
+
+	/**
+	 * Cross product of the xyz parts, w of the result is 0.
+	 * @param rhs Right hand side argument of binary operator.
+	 */
+	Vector4<T> crossProduct(const Vector4<T>& rhs) const
+	{
+		return Vector4<T>(y * rhs.z - rhs.y * z, z * rhs.x - rhs.z * x, x * rhs.y - rhs.x * y, 0);
+	}
+
 	//--------------[ misc. operations ]-----------------------
 	/**
 	 * Linear interpolation of two vectors
@@ -2110,6 +2106,18 @@ typedef Matrix3<double> Matrix3d;
 /// Matrix 3x3 of int
 typedef Matrix3<int> Matrix3i;
 
+/**
+ * What a Matrix4 is known to be, selects the path of Matrix4::inverse().
+ * Rigid is rotation and translation only, Affine has (0, 0, 0, 1) as its
+ * last row.
+ */
+enum class MatrixKind
+{
+	General,
+	Affine,
+	Rigid
+};
+
 /**
  * Class for matrix 4x4 
  * @note Data stored in this matrix are in column major order. This arrangement suits OpenGL.
@@ -2120,8 +2128,8 @@ template<class T>
 class Matrix4
 {
 public:
-	/// Data stored in column major order
-	T data[16];
+	/// Data stored in column major order, aligned for SIMD loads
+	alignas(16) T data[16];
 
 	//--------------------------[ constructors ]-------------------------------
 	/**
@@ -2793,63 +2801,121 @@ public:
 
 	/**
 	 * Computes inverse matrix
+	 * @param kind What the matrix is known to be, selects a faster path
+	 * for rigid and affine transforms.
 	 * @return Inverse matrix of this matrix.
-	 * @note This is a little bit time consuming operation
-	 * (16 * 6 * 3 muls, 16 * 5 adds + det() + mul() functions)
 	 */
-	Matrix4<T> inverse()
+	Matrix4<T> inverse(MatrixKind kind = MatrixKind::General) const
 	{
-		Matrix4<T> ret;
-
-		ret.at(0, 0) = +at(2, 1) * at(3, 2) * at(1, 3) - at(3, 1) * at(2, 2) * at(1, 3) + at(3, 1) * at(1, 2) * at(2, 3)
-				- at(1, 1) * at(3, 2) * at(2, 3) - at(2, 1) * at(1, 2) * at(3, 3) + at(1, 1) * at(2, 2) * at(3, 3);
-
-		ret.at(1, 0) = +at(3, 0) * at(2, 2) * at(1, 3) - at(2, 0) * at(3, 2) * at(1, 3) - at(3, 0) * at(1, 2) * at(2, 3)
-				+ at(1, 0) * at(3, 2) * at(2, 3) + at(2, 0) * at(1, 2) * at(3, 3) - at(1, 0) * at(2, 2) * at(3, 3);
-
-		ret.at(2, 0) = +at(2, 0) * at(3, 1) * at(1, 3) - at(3, 0) * at(2, 1) * at(1, 3) + at(3, 0) * at(1, 1) * at(2, 3)
-				- at(1, 0) * at(3, 1) * at(2, 3) - at(2, 0) * at(1, 1) * at(3, 3) + at(1, 0) * at(2, 1) * at(3, 3);
-
-		ret.at(3, 0) = +at(3, 0) * at(2, 1) * at(1, 2) - at(2, 0) * at(3, 1) * at(1, 2) - at(3, 0) * at(1, 1) * at(2, 2)
-				+ at(1, 0) * at(3, 1) * at(2, 2) + at(2, 0) * at(1, 1) * at(3, 2) - at(1, 0) * at(2, 1) * at(3, 2);
-
-		ret.at(0, 1) = +at(3, 1) * at(2, 2) * at(0, 3) - at(2, 1) * at(3, 2) * at(0, 3) - at(3, 1) * at(0, 2) * at(2, 3)
-				+ at(0, 1) * at(3, 2) * at(2, 3) + at(2, 1) * at(0, 2) * at(3, 3) - at(0, 1) * at(2, 2) * at(3, 3);
-
-		ret.at(1, 1) = +at(2, 0) * at(3, 2) * at(0, 3) - at(3, 0) * at(2, 2) * at(0, 3) + at(3, 0) * at(0, 2) * at(2, 3)
-				- at(0, 0) * at(3, 2) * at(2, 3) - at(2, 0) * at(0, 2) * at(3, 3) + at(0, 0) * at(2, 2) * at(3, 3);
-
-		ret.at(2, 1) = +at(3, 0) * at(2, 1) * at(0, 3) - at(2, 0) * at(3, 1) * at(0, 3) - at(3, 0) * at(0, 1) * at(2, 3)
-				+ at(0, 0) * at(3, 1) * at(2, 3) + at(2, 0) * at(0, 1) * at(3, 3) - at(0, 0) * at(2, 1) * at(3, 3);
-
-		ret.at(3, 1) = +at(2, 0) * at(3, 1) * at(0, 2) - at(3, 0) * at(2, 1) * at(0, 2) + at(3, 0) * at(0, 1) * at(2, 2)
-				- at(0, 0) * at(3, 1) * at(2, 2) - at(2, 0) * at(0, 1) * at(3, 2) + at(0, 0) * at(2, 1) * at(3, 2);
+		switch (kind)
+		{
+		case MatrixKind::Rigid:
+			return inverseRigid();
+		case MatrixKind::Affine:
+			return inverseAffine();
+		default:
+			return inverseGeneral();
+		}
+	}
 
-		ret.at(0, 2) = +at(1, 1) * at(3, 2) * at(0, 3) - at(3, 1) * at(1, 2) * at(0, 3) + at(3, 1) * at(0, 2) * at(1, 3)
-				- at(0, 1) * at(3, 2) * at(1, 3) - at(1, 1) * at(0, 2) * at(3, 3) + at(0, 1) * at(1, 2) * at(3, 3);
+	/**
+	 * Inverse of a rotation followed by a translation: the transposed
+	 * rotation and the translation rotated back and negated.
+	 */
+	Matrix4<T> inverseRigid() const
+	{
+		Matrix4<T> ret;
+		for (int i = 0; i < 3; i++)
+		{
+			for (int j = 0; j < 3; j++)
+			{
+				ret.at(i, j) = at(j, i);
+			}
+		}
+		ret.setTranslation(-(ret * getTranslation()));
+		return ret;
+	}
 
-		ret.at(1, 2) = +at(3, 0) * at(1, 2) * at(0, 3) - at(1, 0) * at(3, 2) * at(0, 3) - at(3, 0) * at(0, 2) * at(1, 3)
-				+ at(0, 0) * at(3, 2) * at(1, 3) + at(1, 0) * at(0, 2) * at(3, 3) - at(0, 0) * at(1, 2) * at(3, 3);
+	/**
+	 * Inverse of a matrix whose last row is (0, 0, 0, 1): the inverse of
+	 * the upper 3x3 part (adjugate / determinant) and the translation
+	 * moved through it.
+	 */
+	Matrix4<T> inverseAffine() const
+	{
+		Matrix4<T> ret;
+		ret.at(0, 0) = at(1, 1) * at(2, 2) - at(2, 1) * at(1, 2);
+		ret.at(0, 1) = at(2, 1) * at(0, 2) - at(0, 1) * at(2, 2);
+		ret.at(0, 2) = at(0, 1) * at(1, 2) - at(1, 1) * at(0, 2);
+		ret.at(1, 0) = at(2, 0) * at(1, 2) - at(1, 0) * at(2, 2);
+		ret.at(1, 1) = at(0, 0) * at(2, 2) - at(2, 0) * at(0, 2);
+		ret.at(1, 2) = at(1, 0) * at(0, 2) - at(0, 0) * at(1, 2);
+		ret.at(2, 0) = at(1, 0) * at(2, 1) - at(2, 0) * at(1, 1);
+		ret.at(2, 1) = at(2, 0) * at(0, 1) - at(0, 0) * at(2, 1);
+		ret.at(2, 2) = at(0, 0) * at(1, 1) - at(1, 0) * at(0, 1);
 
-		ret.at(2, 2) = +at(1, 0) * at(3, 1) * at(0, 3) - at(3, 0) * at(1, 1) * at(0, 3) + at(3, 0) * at(0, 1) * at(1, 3)
-				- at(0, 0) * at(3, 1) * at(1, 3) - at(1, 0) * at(0, 1) * at(3, 3) + at(0, 0) * at(1, 1) * at(3, 3);
+		// Expanded along the first row, reusing the cofactors
+		const T invDet = 1 / (at(0, 0) * ret.at(0, 0) + at(1, 0) * ret.at(0, 1) + at(2, 0) * ret.at(0, 2));
+		for (int i = 0; i < 3; i++)
+		{
+			for (int j = 0; j < 3; j++)
+			{
+				ret.at(i, j) *= invDet;
+			}
+		}
 
-		ret.at(3, 2) = +at(3, 0) * at(1, 1) * at(0, 2) - at(1, 0) * at(3, 1) * at(0, 2) - at(3, 0) * at(0, 1) * at(1, 2)
-				+ at(0, 0) * at(3, 1) * at(1, 2) + at(1, 0) * at(0, 1) * at(3, 2) - at(0, 0) * at(1, 1) * at(3, 2);
+		ret.setTranslation(-(ret * getTranslation()));
+		return ret;
+	}
 
-		ret.at(0, 3) = +at(2, 1) * at(1, 2) * at(0, 3) - at(1, 1) * at(2, 2) * at(0, 3) - at(2, 1) * at(0, 2) * at(1, 3)
-				+ at(0, 1) * at(2, 2) * at(1, 3) + at(1, 1) * at(0, 2) * at(2, 3) - at(0, 1) * at(1, 2) * at(2, 3);
+	/**
+	 * Inverse of any invertible matrix, by Laplace expansion over the 2x2
+	 * minors of the upper and lower two rows. Each minor is computed once,
+	 * about a third of the multiplies of the plain cofactor expansion.
+	 */
+	Matrix4<T> inverseGeneral() const
+	{
+		// a(r, c) is row r, column c
+		auto a = [this](int r, int c) { return data[c * 4 + r]; };
 
-		ret.at(1, 3) = +at(1, 0) * at(2, 2) * at(0, 3) - at(2, 0) * at(1, 2) * at(0, 3) + at(2, 0) * at(0, 2) * at(1, 3)
-				- at(0, 0) * at(2, 2) * at(1, 3) - at(1, 0) * at(0, 2) * at(2, 3) + at(0, 0) * at(1, 2) * at(2, 3);
+		const T s0 = a(0, 0) * a(1, 1) - a(1, 0) * a(0, 1);
+		const T s1 = a(0, 0) * a(1, 2) - a(1, 0) * a(0, 2);
+		const T s2 = a(0, 0) * a(1, 3) - a(1, 0) * a(0, 3);
+		const T s3 = a(0, 1) * a(1, 2) - a(1, 1) * a(0, 2);
+		const T s4 = a(0, 1) * a(1, 3) - a(1, 1) * a(0, 3);
+		const T s5 = a(0, 2) * a(1, 3) - a(1, 2) * a(0, 3);
 
-		ret.at(2, 3) = +at(2, 0) * at(1, 1) * at(0, 3) - at(1, 0) * at(2, 1) * at(0, 3) - at(2, 0) * at(0, 1) * at(1, 3)
-				+ at(0, 0) * at(2, 1) * at(1, 3) + at(1, 0) * at(0, 1) * at(2, 3) - at(0, 0) * at(1, 1) * at(2, 3);
+		const T c5 = a(2, 2) * a(3, 3) - a(3, 2) * a(2, 3);
+		const T c4 = a(2, 1) * a(3, 3) - a(3, 1) * a(2, 3);
+		const T c3 = a(2, 1) * a(3, 2) - a(3, 1) * a(2, 2);
+		const T c2 = a(2, 0) * a(3, 3) - a(3, 0) * a(2, 3);
+		const T c1 = a(2, 0) * a(3, 2) - a(3, 0) * a(2, 2);
+		const T c0 = a(2, 0) * a(3, 1) - a(3, 0) * a(2, 1);
 
-		ret.at(3, 3) = +at(1, 0) * at(2, 1) * at(0, 2) - at(2, 0) * at(1, 1) * at(0, 2) + at(2, 0) * at(0, 1) * at(1, 2)
-				- at(0, 0) * at(2, 1) * at(1, 2) - at(1, 0) * at(0, 1) * at(2, 2) + at(0, 0) * at(1, 1) * at(2, 2);
+		const T invDet = 1 / (s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0);
 
-		return ret / det();
+		Matrix4<T> ret;
+		T* b = ret.data;
+		b[0] = (a(1, 1) * c5 - a(1, 2) * c4 + a(1, 3) * c3) * invDet;
+		b[4] = (-a(0, 1) * c5 + a(0, 2) * c4 - a(0, 3) * c3) * invDet;
+		b[8] = (a(3, 1) * s5 - a(3, 2) * s4 + a(3, 3) * s3) * invDet;
+		b[12] = (-a(2, 1) * s5 + a(2, 2) * s4 - a(2, 3) * s3) * invDet;
+
+		b[1] = (-a(1, 0) * c5 + a(1, 2) * c2 - a(1, 3) * c1) * invDet;
+		b[5] = (a(0, 0) * c5 - a(0, 2) * c2 + a(0, 3) * c1) * invDet;
+		b[9] = (-a(3, 0) * s5 + a(3, 2) * s2 - a(3, 3) * s1) * invDet;
+		b[13] = (a(2, 0) * s5 - a(2, 2) * s2 + a(2, 3) * s1) * invDet;
+
+		b[2] = (a(1, 0) * c4 - a(1, 1) * c2 + a(1, 3) * c0) * invDet;
+		b[6] = (-a(0, 0) * c4 + a(0, 1) * c2 - a(0, 3) * c0) * invDet;
+		b[10] = (a(3, 0) * s4 - a(3, 1) * s2 + a(3, 3) * s0) * invDet;
+		b[14] = (-a(2, 0) * s4 + a(2, 1) * s2 - a(2, 3) * s0) * invDet;
+
+		b[3] = (-a(1, 0) * c3 + a(1, 1) * c1 - a(1, 2) * c0) * invDet;
+		b[7] = (a(0, 0) * c3 - a(0, 1) * c1 + a(0, 2) * c0) * invDet;
+		b[11] = (-a(3, 0) * s3 + a(3, 1) * s1 - a(3, 2) * s0) * invDet;
+		b[15] = (a(2, 0) * s3 - a(2, 1) * s1 + a(2, 2) * s0) * invDet;
+		return ret;
 	}
 
 	/**
@@ -3225,7 +3291,7 @@ public:
 	 * Converts quaternion into rotation matrix.
 	 * @return Rotation matrix expressing this quaternion.
 	 */
-	Matrix3<T> rotMatrix()
+	Matrix3<T> rotMatrix() const
 	{
 		Matrix3<T> ret;
 
@@ -3465,12 +3531,16 @@ public:
 	}
 	
 	/**
-	 * Rotates a vector by this quaternion seen as a rotation quaternion
+	 * Rotates a vector by this quaternion seen as a rotation quaternion.
+	 * The quaternion must be of unit length.
 	 */
 	Vector3<T> rotate(const Vector3<T> &vec) const
 	{
-		Quaternion<T> ret = (*this) * Quaternion<T>(0, vec) * ~(*this);
-		return ret.v;
+		// Expansion of q * (0, vec) * ~q for unit q, two cross
+		// products instead of two quaternion products:
+		// vec + w * t + v x t, with t = 2 * (v x vec)
+		Vector3<T> t = v.crossProduct(vec) * 2;
+		return vec + t * w + v.crossProduct(t);
 	}
 	/**
 	 * Rotates a vector inverse to the rotation quaternion.
@@ -3478,8 +3548,9 @@ public:
 	 */
 	Vector3<T> inverseRotate(const Vector3<T> &vec) const
 	{
-		Quaternion<T> ret = ~(*this) * Quaternion<T>(0, vec) * (*this);
-		return ret.v;
+		// As rotate() with v negated
+		Vector3<T> t = vec.crossProduct(v) * 2;
+		return vec + t * w + t.crossProduct(v);
 	}
 
 	/**
@@ -4045,6 +4116,8 @@ namespace VMATH_NAMESPACE
 	typedef Aabb3<float> Aabb3f;
 	typedef Aabb3<double> Aabb3d;
 
+#include "vmath_simd.h"
+
 #ifdef VMATH_NAMESPACE
 }
 #endif //VMATH_NAMESPACE
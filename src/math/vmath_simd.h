@@ -0,0 +1,211 @@
+// SSE/AVX versions of the hot Vector4 and Matrix4 operations for float and
+// double. Included by vmath.h (inside its namespace) after the class
+// templates, the generic code is used without SSE2 or with VMATH_NO_SIMD.
+//
+// Products are summed in the same order as the generic code and no FMA is
+// used, so matrix results are bit for bit the same. Dot products and lengths
+// sum pairwise and may differ in the last bit.
+#ifndef __vmath_simd_Header_File__
+#define __vmath_simd_Header_File__
+
+#ifdef VMATH_SIMD
+
+namespace vmath_simd
+{
+	// out = m * v, m in column major order, all pointers 16 byte aligned
+	inline void mul(const float* m, const float* v, float* out)
+	{
+		__m128 vv = _mm_load_ps(v);
+		__m128 r = _mm_mul_ps(_mm_load_ps(m), _mm_shuffle_ps(vv, vv, 0x00));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(m + 4), _mm_shuffle_ps(vv, vv, 0x55)));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(m + 8), _mm_shuffle_ps(vv, vv, 0xaa)));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(m + 12), _mm_shuffle_ps(vv, vv, 0xff)));
+		_mm_store_ps(out, r);
+	}
+
+	inline void mul(const double* m, const double* v, double* out)
+	{
+#ifdef __AVX__
+		// Columns are only guaranteed 16 byte alignment
+		__m256d r = _mm256_mul_pd(_mm256_loadu_pd(m), _mm256_set1_pd(v[0]));
+		r = _mm256_add_pd(r, _mm256_mul_pd(_mm256_loadu_pd(m + 4), _mm256_set1_pd(v[1])));
+		r = _mm256_add_pd(r, _mm256_mul_pd(_mm256_loadu_pd(m + 8), _mm256_set1_pd(v[2])));
+		r = _mm256_add_pd(r, _mm256_mul_pd(_mm256_loadu_pd(m + 12), _mm256_set1_pd(v[3])));
+		_mm256_storeu_pd(out, r);
+#else
+		// Rows 0-1 and 2-3 in two halves
+		for (int i = 0; i < 4; i += 2)
+		{
+			__m128d r = _mm_mul_pd(_mm_load_pd(m + i), _mm_set1_pd(v[0]));
+			r = _mm_add_pd(r, _mm_mul_pd(_mm_load_pd(m + 4 + i), _mm_set1_pd(v[1])));
+			r = _mm_add_pd(r, _mm_mul_pd(_mm_load_pd(m + 8 + i), _mm_set1_pd(v[2])));
+			r = _mm_add_pd(r, _mm_mul_pd(_mm_load_pd(m + 12 + i), _mm_set1_pd(v[3])));
+			_mm_store_pd(out + i, r);
+		}
+#endif
+	}
+
+	inline float dot(const float* a, const float* b)
+	{
+		__m128 m = _mm_mul_ps(_mm_load_ps(a), _mm_load_ps(b));
+		m = _mm_add_ps(m, _mm_movehl_ps(m, m));
+		m = _mm_add_ss(m, _mm_shuffle_ps(m, m, 1));
+		return _mm_cvtss_f32(m);
+	}
+
+	inline double dot(const double* a, const double* b)
+	{
+		__m128d m = _mm_add_pd(_mm_mul_pd(_mm_load_pd(a), _mm_load_pd(b)),
+							   _mm_mul_pd(_mm_load_pd(a + 2), _mm_load_pd(b + 2)));
+		m = _mm_add_sd(m, _mm_unpackhi_pd(m, m));
+		return _mm_cvtsd_f64(m);
+	}
+}
+
+//--------------------------------[ Vector4 ]----------------------------------
+
+template<>
+inline float Vector4<float>::dotProduct(const Vector4<float>& rhs) const
+{
+	return vmath_simd::dot(&x, &rhs.x);
+}
+
+template<>
+inline double Vector4<double>::dotProduct(const Vector4<double>& rhs) const
+{
+	return vmath_simd::dot(&x, &rhs.x);
+}
+
+template<>
+inline Vector4<float> Vector4<float>::crossProduct(const Vector4<float>& rhs) const
+{
+	// a.yzx * b.zxy - a.zxy * b.yzx, w ends up 0
+	__m128 a = _mm_load_ps(&x);
+	__m128 b = _mm_load_ps(&rhs.x);
+	__m128 aYzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 bYzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 aZxy = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2));
+	__m128 bZxy = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 0, 2));
+
+	Vector4<float> ret;
+	_mm_store_ps(&ret.x, _mm_sub_ps(_mm_mul_ps(aYzx, bZxy), _mm_mul_ps(aZxy, bYzx)));
+	return ret;
+}
+
+template<>
+inline float Vector4<float>::length() const
+{
+	return std::sqrt(vmath_simd::dot(&x, &x));
+}
+
+template<>
+inline double Vector4<double>::length() const
+{
+	return std::sqrt(vmath_simd::dot(&x, &x));
+}
+
+template<>
+inline void Vector4<float>::normalize()
+{
+	__m128 v = _mm_load_ps(&x);
+	_mm_store_ps(&x, _mm_div_ps(v, _mm_set1_ps(length())));
+}
+
+template<>
+inline void Vector4<double>::normalize()
+{
+	__m128d s = _mm_set1_pd(length());
+	_mm_store_pd(&x, _mm_div_pd(_mm_load_pd(&x), s));
+	_mm_store_pd(&z, _mm_div_pd(_mm_load_pd(&z), s));
+}
+
+//--------------------------------[ Matrix4 ]----------------------------------
+
+template<>
+inline Vector4<float> Matrix4<float>::operator*(const Vector4<float>& rhs) const
+{
+	// Broadcast from the scalars like the double version. rhs is often just
+	// built one component at a time, and a vector load of it would stall
+	// waiting for those stores.
+	__m128 r = _mm_mul_ps(_mm_load_ps(data), _mm_set1_ps(rhs.x));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(data + 4), _mm_set1_ps(rhs.y)));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(data + 8), _mm_set1_ps(rhs.z)));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(data + 12), _mm_set1_ps(rhs.w)));
+
+	Vector4<float> ret;
+	_mm_store_ps(&ret.x, r);
+	return ret;
+}
+
+template<>
+inline Vector4<double> Matrix4<double>::operator*(const Vector4<double>& rhs) const
+{
+	Vector4<double> ret;
+	vmath_simd::mul(data, &rhs.x, &ret.x);
+	return ret;
+}
+
+template<>
+inline Matrix4<float> Matrix4<float>::operator*(Matrix4<float> rhs) const
+{
+	// Column i of the result is this * column i of rhs
+	Matrix4<float> ret;
+	for (int i = 0; i < 16; i += 4)
+	{
+		vmath_simd::mul(data, rhs.data + i, ret.data + i);
+	}
+	return ret;
+}
+
+template<>
+inline Matrix4<double> Matrix4<double>::operator*(Matrix4<double> rhs) const
+{
+	Matrix4<double> ret;
+	for (int i = 0; i < 16; i += 4)
+	{
+		vmath_simd::mul(data, rhs.data + i, ret.data + i);
+	}
+	return ret;
+}
+
+template<>
+inline Matrix4<float> Matrix4<float>::transpose()
+{
+	__m128 c0 = _mm_load_ps(data);
+	__m128 c1 = _mm_load_ps(data + 4);
+	__m128 c2 = _mm_load_ps(data + 8);
+	__m128 c3 = _mm_load_ps(data + 12);
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+	Matrix4<float> ret;
+	_mm_store_ps(ret.data, c0);
+	_mm_store_ps(ret.data + 4, c1);
+	_mm_store_ps(ret.data + 8, c2);
+	_mm_store_ps(ret.data + 12, c3);
+	return ret;
+}
+
+template<>
+inline Matrix4<double> Matrix4<double>::transpose()
+{
+	// 2x2 blocks, lo holds rows 0-1 of a column and hi rows 2-3
+	Matrix4<double> ret;
+	for (int half = 0; half < 2; half++)
+	{
+		__m128d c0 = _mm_load_pd(data + half * 2);
+		__m128d c1 = _mm_load_pd(data + 4 + half * 2);
+		__m128d c2 = _mm_load_pd(data + 8 + half * 2);
+		__m128d c3 = _mm_load_pd(data + 12 + half * 2);
+
+		double* out = ret.data + half * 8;
+		_mm_store_pd(out, _mm_unpacklo_pd(c0, c1));
+		_mm_store_pd(out + 2, _mm_unpacklo_pd(c2, c3));
+		_mm_store_pd(out + 4, _mm_unpackhi_pd(c0, c1));
+		_mm_store_pd(out + 6, _mm_unpackhi_pd(c2, c3));
+	}
+	return ret;
+}
+
+#endif // VMATH_SIMD
+
+#endif // __vmath_simd_Header_File__
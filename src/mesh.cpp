@@ -0,0 +1,313 @@
+#include "mesh.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+
+void Mesh::updateBounds()
+{
+	bounds.invalidate();
+	for (const auto& tri : triangles)
+	{
+		bounds << Vector3d(tri.p0) << Vector3d(tri.p1) << Vector3d(tri.p2);
+	}
+	
+	// Sphere around the box center, usually tighter than the box diagonal
+	center = bounds.valid() ? bounds.center() : Vector3d();
+	double radiusSq = 0.0;
+	for (const auto& tri : triangles)
+	{
+		radiusSq = std::max(radiusSq, (Vector3d(tri.p0) - center).lengthSq());
+		radiusSq = std::max(radiusSq, (Vector3d(tri.p1) - center).lengthSq());
+		radiusSq = std::max(radiusSq, (Vector3d(tri.p2) - center).lengthSq());
+	}
+	radius = std::sqrt(radiusSq);
+}
+
+void Mesh::groupByMaterial(const std::vector<int>& triMaterials)
+{
+	const int materialCount = (int)materials.size();
+	int defaultMaterial = -1;
+	
+	std::vector<int> ids(triangles.size());
+	for (size_t i = 0; i < triangles.size(); i++)
+	{
+		int id = i < triMaterials.size() ? triMaterials[i] : -1;
+		if (id < 0 || id >= materialCount)
+		{
+			if (defaultMaterial < 0)
+			{
+				defaultMaterial = (int)materials.size();
+				materials.push_back(Material());
+			}
+			id = defaultMaterial;
+		}
+		ids[i] = id;
+	}
+	
+	// Stable, so the original triangle order is kept within a material
+	std::vector<size_t> order(triangles.size());
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [&ids](size_t a, size_t b) { return ids[a] < ids[b]; });
+	
+	std::vector<Triangle3r> sorted;
+	sorted.reserve(triangles.size());
+	ranges.clear();
+	
+	for (size_t idx : order)
+	{
+		if (ranges.empty() || ranges.back().material != ids[idx])
+		{
+			MeshRange range;
+			range.material = ids[idx];
+			range.first = sorted.size();
+			range.count = 0;
+			range.firstMeshlet = 0;
+			range.meshletCount = 0;
+			ranges.push_back(range);
+		}
+		
+		sorted.push_back(triangles[idx]);
+		ranges.back().count++;
+	}
+	
+	triangles.swap(sorted);
+	meshlets.clear();
+}
+
+void Mesh::buildMeshlets(size_t minTriangles, size_t maxTriangles, double minNormalDot)
+{
+	meshlets.clear();
+	
+	// Corners sharing a position are the same vertex
+	std::map<Vector3r, size_t, math::PositionLess> welded;
+	std::vector<size_t> corners(triangles.size() * 3);
+	for (size_t i = 0; i < triangles.size(); i++)
+	{
+		const Vector3r* p[3] = { &triangles[i].p0, &triangles[i].p1, &triangles[i].p2 };
+		for (int j = 0; j < 3; j++)
+		{
+			auto it = welded.insert(std::make_pair(*p[j], welded.size())).first;
+			corners[i * 3 + j] = it->second;
+		}
+	}
+	
+	std::vector<std::vector<size_t>> vertexTris(welded.size());
+	for (size_t i = 0; i < corners.size(); i++)
+	{
+		vertexTris[corners[i]].push_back(i / 3);
+	}
+	
+	std::vector<Vector3d> normals(triangles.size());
+	std::vector<Vector3d> centroids(triangles.size());
+	for (size_t i = 0; i < triangles.size(); i++)
+	{
+		const Triangle3d tri = triangles[i];
+		normals[i] = (tri.p1 - tri.p0).crossProduct(tri.p2 - tri.p0);
+		if (normals[i].lengthSq() > 0.0)
+		{
+			normals[i].normalize();
+		}
+		centroids[i] = (tri.p0 + tri.p1 + tri.p2) / 3.0;
+	}
+	
+	std::vector<bool> assigned(triangles.size(), false);
+	std::vector<bool> queued(triangles.size(), false);
+	std::vector<size_t> order;
+	std::vector<size_t> frontier;
+	
+	for (auto& range : ranges)
+	{
+		const size_t end = range.first + range.count;
+		range.firstMeshlet = meshlets.size();
+		
+		// Expected meshlet radius, a disc of maxTriangles average triangles
+		double area = 0.0;
+		for (size_t i = range.first; i < end; i++)
+		{
+			const Triangle3d tri = triangles[i];
+			area += (tri.p1 - tri.p0).crossProduct(tri.p2 - tri.p0).length() * 0.5;
+		}
+		double expectedRadius = std::sqrt(area / std::max<size_t>(range.count, 1) * maxTriangles / M_PI);
+		if (expectedRadius <= 0.0)
+		{
+			expectedRadius = 1.0;
+		}
+		
+		order.clear();
+		for (size_t seed = range.first; seed < end; seed++)
+		{
+			if (assigned[seed])
+			{
+				continue;
+			}
+			
+			Meshlet meshlet;
+			meshlet.first = range.first + order.size();
+			meshlet.count = 0;
+			meshlet.radius = 0.0;
+			meshlet.coneCutoff = 2.0;
+			
+			Vector3d axis;
+			Vector3d centroid;
+			size_t added = seed;
+			frontier.clear();
+			
+			while (true)
+			{
+				assigned[added] = true;
+				order.push_back(added);
+				axis += normals[added];
+				centroid += centroids[added];
+				
+				if (++meshlet.count >= maxTriangles)
+				{
+					break;
+				}
+				
+				// Neighbours over shared vertices, within the same range
+				for (int j = 0; j < 3; j++)
+				{
+					for (size_t tri : vertexTris[corners[added * 3 + j]])
+					{
+						if (tri >= range.first && tri < end && !assigned[tri] && !queued[tri])
+						{
+							queued[tri] = true;
+							frontier.push_back(tri);
+						}
+					}
+				}
+				
+				// A piece ran out below the minimum, continue from the nearest
+				// unassigned triangle rather than leave a tiny meshlet
+				if (frontier.empty())
+				{
+					if (meshlet.count >= minTriangles)
+					{
+						break;
+					}
+					
+					Vector3d center = centroid / (double)meshlet.count;
+					double nearestSq = std::numeric_limits<double>::max();
+					for (size_t tri = seed + 1; tri < end; tri++)
+					{
+						double distSq = (centroids[tri] - center).lengthSq();
+						if (!assigned[tri] && distSq < nearestSq)
+						{
+							nearestSq = distSq;
+							added = tri;
+						}
+					}
+					
+					if (nearestSq == std::numeric_limits<double>::max())
+					{
+						break;
+					}
+					continue;
+				}
+				
+				// Favour normals close to the cluster's, then compactness
+				Vector3d center = centroid / (double)meshlet.count;
+				double axisLength = axis.length();
+				size_t best = 0;
+				double bestFacing = 0.0;
+				double bestScore = -std::numeric_limits<double>::max();
+				for (size_t i = 0; i < frontier.size(); i++)
+				{
+					size_t tri = frontier[i];
+					double facing = axisLength > 0.0 ? normals[tri].dotProduct(axis) / axisLength : 0.0;
+					double score = facing - (centroids[tri] - center).length() / expectedRadius;
+					if (score > bestScore)
+					{
+						bestScore = score;
+						bestFacing = facing;
+						best = i;
+					}
+				}
+				
+				// A wide cone never culls, rather start a new meshlet once this
+				// one is large enough to be worth a test of its own
+				if (bestFacing < minNormalDot && meshlet.count >= minTriangles)
+				{
+					break;
+				}
+				
+				added = frontier[best];
+				frontier[best] = frontier.back();
+				frontier.pop_back();
+			}
+			
+			for (size_t tri : frontier)
+			{
+				queued[tri] = false;
+			}
+			
+			meshlets.push_back(meshlet);
+		}
+		
+		// Move the triangles into meshlet order
+		std::vector<Triangle3r> sorted(order.size());
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			sorted[i] = triangles[order[i]];
+		}
+		std::copy(sorted.begin(), sorted.end(), triangles.begin() + range.first);
+		
+		range.meshletCount = meshlets.size() - range.firstMeshlet;
+	}
+	
+	for (auto& meshlet : meshlets)
+	{
+		Aabb3d box;
+		for (size_t i = meshlet.first; i < meshlet.first + meshlet.count; i++)
+		{
+			box << Vector3d(triangles[i].p0) << Vector3d(triangles[i].p1) << Vector3d(triangles[i].p2);
+		}
+		
+		meshlet.center = box.center();
+		double radiusSq = 0.0;
+		Vector3d axis;
+		for (size_t i = meshlet.first; i < meshlet.first + meshlet.count; i++)
+		{
+			const Triangle3d tri = triangles[i];
+			radiusSq = std::max(radiusSq, (tri.p0 - meshlet.center).lengthSq());
+			radiusSq = std::max(radiusSq, (tri.p1 - meshlet.center).lengthSq());
+			radiusSq = std::max(radiusSq, (tri.p2 - meshlet.center).lengthSq());
+			
+			Vector3d n = (tri.p1 - tri.p0).crossProduct(tri.p2 - tri.p0);
+			if (n.lengthSq() > 0.0)
+			{
+				n.normalize();
+				axis += n;
+			}
+		}
+		meshlet.radius = std::sqrt(radiusSq);
+		
+		// Widest normal decides the cone, degenerate faces never render
+		meshlet.coneCutoff = 2.0;
+		if (axis.lengthSq() > 0.0)
+		{
+			axis.normalize();
+			double minDot = 1.0;
+			for (size_t i = meshlet.first; i < meshlet.first + meshlet.count; i++)
+			{
+				const Triangle3d tri = triangles[i];
+				Vector3d n = (tri.p1 - tri.p0).crossProduct(tri.p2 - tri.p0);
+				if (n.lengthSq() > 0.0)
+				{
+					n.normalize();
+					minDot = std::min(minDot, n.dotProduct(axis));
+				}
+			}
+			
+			if (minDot > 0.0)
+			{
+				meshlet.coneCutoff = std::sqrt(1.0 - minDot * minDot);
+			}
+		}
+		meshlet.coneAxis = axis;
+	}
+}
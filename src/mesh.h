@@ -0,0 +1,69 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <cstddef>
+#include <vector>
+
+#include "math/vmath.h"
+#include "math/common.h"
+#include "material.h"
+
+// Contiguous triangles sharing one material
+struct MeshRange
+{
+	int material;
+	size_t first, count;
+	
+	// Meshlets covering the range, none until Mesh::buildMeshlets
+	size_t firstMeshlet, meshletCount;
+};
+
+// Cluster of connected triangles within one range, culled as a whole
+struct Meshlet
+{
+	size_t first, count;
+	
+	// Bounding sphere in object space
+	Vector3d center;
+	double radius;
+	
+	// Every face normal is within the cone around axis. cutoff is the sine
+	// of the cone's half angle, above 1 if the cone is too wide to cull.
+	Vector3d coneAxis;
+	double coneCutoff;
+};
+
+struct Mesh
+{
+	Mesh() : radius(0.0) {}
+	
+	std::vector<Triangle3r> triangles;
+	
+	// Material table, indexed by MeshRange::material
+	std::vector<Material> materials;
+	std::vector<MeshRange> ranges;
+	std::vector<Meshlet> meshlets;
+	
+	// Bounds in object space
+	Aabb3d bounds;
+	Vector3d center;
+	double radius;
+	
+	// Recalculate bounding box and sphere from the triangles
+	void updateBounds();
+	
+	// Reorder triangles into one range per material. triMaterials holds the
+	// material index of each triangle; invalid indices (e.g. -1) get a
+	// default material appended to the table.
+	void groupByMaterial(const std::vector<int>& triMaterials);
+	
+	// Partition each range into meshlets of minTriangles to maxTriangles,
+	// grown over shared vertices while preferring similar normals. Past
+	// minTriangles growth stops early at a normal further than
+	// acos(minNormalDot) from the meshlet's average, so the cones stay
+	// narrow enough to cull. Only a range's last meshlets can fall short of
+	// minTriangles. Reorders the triangles within their range.
+	void buildMeshlets(size_t minTriangles = 64, size_t maxTriangles = 128, double minNormalDot = 0.7);
+};
+
+#endif
@@ -0,0 +1,533 @@
+#include "meshlod.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <queue>
+#include <utility>
+
+namespace
+{
+	// Error weight of the planes holding open borders in place
+	const double xcBorderWeight = 1000.0;
+	
+	// Collapses turning a face normal further than this (cosine) are rejected
+	const double xcMinNormalDot = 0.2;
+	
+	// Symmetric 4x4 matrix, sum of squared distances to a set of planes
+	struct Quadric
+	{
+		double a00, a01, a02, a03;
+		double a11, a12, a13;
+		double a22, a23;
+		double a33;
+		
+		Quadric() :
+			a00(0.0), a01(0.0), a02(0.0), a03(0.0),
+			a11(0.0), a12(0.0), a13(0.0),
+			a22(0.0), a23(0.0),
+			a33(0.0)
+		{
+		}
+		
+		// Plane n.p + d = 0, n normalized
+		Quadric(const Vector3d& n, double d, double weight) :
+			a00(n.x * n.x * weight), a01(n.x * n.y * weight), a02(n.x * n.z * weight), a03(n.x * d * weight),
+			a11(n.y * n.y * weight), a12(n.y * n.z * weight), a13(n.y * d * weight),
+			a22(n.z * n.z * weight), a23(n.z * d * weight),
+			a33(d * d * weight)
+		{
+		}
+		
+		Quadric& operator+=(const Quadric& rhs)
+		{
+			a00 += rhs.a00; a01 += rhs.a01; a02 += rhs.a02; a03 += rhs.a03;
+			a11 += rhs.a11; a12 += rhs.a12; a13 += rhs.a13;
+			a22 += rhs.a22; a23 += rhs.a23;
+			a33 += rhs.a33;
+			return *this;
+		}
+		
+		double error(const Vector3d& p) const
+		{
+			return a00 * p.x * p.x + 2.0 * a01 * p.x * p.y + 2.0 * a02 * p.x * p.z + 2.0 * a03 * p.x +
+				   a11 * p.y * p.y + 2.0 * a12 * p.y * p.z + 2.0 * a13 * p.y +
+				   a22 * p.z * p.z + 2.0 * a23 * p.z +
+				   a33;
+		}
+		
+		// Position of minimal error, false if the system is (nearly) singular
+		bool optimum(Vector3d& p) const
+		{
+			double c00 = a11 * a22 - a12 * a12;
+			double c01 = a02 * a12 - a01 * a22;
+			double c02 = a01 * a12 - a02 * a11;
+			double det = a00 * c00 + a01 * c01 + a02 * c02;
+			
+			double scale = (a00 + a11 + a22) / 3.0;
+			if (std::abs(det) <= 1e-9 * scale * scale * scale)
+			{
+				return false;
+			}
+			
+			double c11 = a00 * a22 - a02 * a02;
+			double c12 = a01 * a02 - a00 * a12;
+			double c22 = a00 * a11 - a01 * a01;
+			
+			// Inverse by cofactors, the matrix is symmetric
+			p.x = -(c00 * a03 + c01 * a13 + c02 * a23) / det;
+			p.y = -(c01 * a03 + c11 * a13 + c12 * a23) / det;
+			p.z = -(c02 * a03 + c12 * a13 + c22 * a23) / det;
+			return true;
+		}
+	};
+	
+	struct Face
+	{
+		int v[3];
+		int material;
+		bool removed;
+	};
+	
+	struct Vertex
+	{
+		Vector3d pos;
+		Vector3d normal;
+		Quadric quadric;
+		
+		// Faces using this vertex, may hold removed faces
+		std::vector<int> faces;
+		
+		// Bumped when the vertex changes, invalidates queued collapses
+		int version;
+		bool removed;
+	};
+	
+	struct Collapse
+	{
+		double cost;
+		int v0, v1;
+		int version0, version1;
+		Vector3d pos;
+		
+		// Lowest cost on top of the queue
+		bool operator<(const Collapse& rhs) const { return cost > rhs.cost; }
+	};
+	
+	class Simplifier
+	{
+	public:
+		Simplifier(const Mesh& mesh);
+		
+		void run(size_t targetTriangles);
+		void write(Mesh& out, const Mesh& in) const;
+	
+	private:
+		std::vector<Vertex> mVerts;
+		std::vector<Face> mFaces;
+		std::priority_queue<Collapse> mQueue;
+		size_t mFaceCount;
+		
+		void addEdgeQuadrics();
+		void push(int v0, int v1);
+		bool flips(int v, int other, const Vector3d& pos) const;
+		void collapse(const Collapse& c);
+	};
+	
+	Simplifier::Simplifier(const Mesh& mesh) :
+		mFaceCount(0)
+	{
+		std::map<Vector3d, int, math::PositionLess> welded;
+		auto vertexFor = [&](const Vector3d& p, const Vector3d& n)
+		{
+			auto it = welded.find(p);
+			if (it != welded.end())
+			{
+				mVerts[it->second].normal += n;
+				return it->second;
+			}
+			
+			Vertex vert;
+			vert.pos = p;
+			vert.normal = n;
+			vert.version = 0;
+			vert.removed = false;
+			mVerts.push_back(vert);
+			
+			int index = (int)mVerts.size() - 1;
+			welded[p] = index;
+			return index;
+		};
+		
+		// Triangles that were never grouped get the default material
+		std::vector<MeshRange> ranges = mesh.ranges;
+		if (ranges.empty())
+		{
+			MeshRange all = { -1, 0, mesh.triangles.size(), 0, 0 };
+			ranges.push_back(all);
+		}
+		
+		for (const auto& range : ranges)
+		{
+			for (size_t i = range.first; i < range.first + range.count; i++)
+			{
+				const Triangle3r& tri = mesh.triangles[i];
+				
+				Face face;
+				face.v[0] = vertexFor(tri.p0, tri.n0);
+				face.v[1] = vertexFor(tri.p1, tri.n1);
+				face.v[2] = vertexFor(tri.p2, tri.n2);
+				face.material = range.material;
+				face.removed = face.v[0] == face.v[1] || face.v[1] == face.v[2] || face.v[2] == face.v[0];
+				if (face.removed)
+				{
+					continue;
+				}
+				
+				int index = (int)mFaces.size();
+				for (int j = 0; j < 3; j++)
+				{
+					mVerts[face.v[j]].faces.push_back(index);
+				}
+				mFaces.push_back(face);
+			}
+		}
+		mFaceCount = mFaces.size();
+		
+		// Area weighted plane of every face
+		for (const auto& face : mFaces)
+		{
+			const Vector3d& p0 = mVerts[face.v[0]].pos;
+			Vector3d n = (mVerts[face.v[1]].pos - p0).crossProduct(mVerts[face.v[2]].pos - p0);
+			double area = n.length() * 0.5;
+			if (area <= 0.0)
+			{
+				continue;
+			}
+			
+			n /= area * 2.0;
+			Quadric q(n, -n.dotProduct(p0), area);
+			for (int j = 0; j < 3; j++)
+			{
+				mVerts[face.v[j]].quadric += q;
+			}
+		}
+		
+		addEdgeQuadrics();
+	}
+	
+	void Simplifier::addEdgeQuadrics()
+	{
+		// Faces sharing each edge, open borders have a single one
+		std::map<std::pair<int, int>, int> edgeFaces;
+		for (const auto& face : mFaces)
+		{
+			for (int j = 0; j < 3; j++)
+			{
+				int a = face.v[j];
+				int b = face.v[(j + 1) % 3];
+				edgeFaces[std::make_pair(std::min(a, b), std::max(a, b))]++;
+			}
+		}
+		
+		for (const auto& face : mFaces)
+		{
+			const Vector3d& p0 = mVerts[face.v[0]].pos;
+			Vector3d faceNormal = (mVerts[face.v[1]].pos - p0).crossProduct(mVerts[face.v[2]].pos - p0);
+			
+			for (int j = 0; j < 3; j++)
+			{
+				int a = face.v[j];
+				int b = face.v[(j + 1) % 3];
+				if (edgeFaces[std::make_pair(std::min(a, b), std::max(a, b))] != 1)
+				{
+					continue;
+				}
+				
+				// Plane through the edge, perpendicular to the face
+				Vector3d edge = mVerts[b].pos - mVerts[a].pos;
+				Vector3d n = edge.crossProduct(faceNormal);
+				if (n.lengthSq() <= 0.0)
+				{
+					continue;
+				}
+				n.normalize();
+				
+				Quadric q(n, -n.dotProduct(mVerts[a].pos), xcBorderWeight * edge.lengthSq());
+				mVerts[a].quadric += q;
+				mVerts[b].quadric += q;
+			}
+		}
+		
+		for (const auto& edge : edgeFaces)
+		{
+			push(edge.first.first, edge.first.second);
+		}
+	}
+	
+	void Simplifier::push(int v0, int v1)
+	{
+		const Vertex& a = mVerts[v0];
+		const Vertex& b = mVerts[v1];
+		
+		Quadric q = a.quadric;
+		q += b.quadric;
+		
+		Collapse c;
+		c.v0 = v0;
+		c.v1 = v1;
+		c.version0 = a.version;
+		c.version1 = b.version;
+		
+		// Best of the optimum, the end points and the midpoint
+		Vector3d candidates[4] = { a.pos, b.pos, (a.pos + b.pos) * 0.5, Vector3d() };
+		int count = q.optimum(candidates[3]) ? 4 : 3;
+		
+		c.cost = std::numeric_limits<double>::max();
+		for (int i = 0; i < count; i++)
+		{
+			double cost = q.error(candidates[i]);
+			if (cost < c.cost)
+			{
+				c.cost = cost;
+				c.pos = candidates[i];
+			}
+		}
+		
+		mQueue.push(c);
+	}
+	
+	bool Simplifier::flips(int v, int other, const Vector3d& pos) const
+	{
+		for (int f : mVerts[v].faces)
+		{
+			const Face& face = mFaces[f];
+			if (face.removed ||
+				face.v[0] == other || face.v[1] == other || face.v[2] == other)
+			{
+				// Removed by the collapse
+				continue;
+			}
+			
+			Vector3d p[3];
+			Vector3d moved[3];
+			for (int j = 0; j < 3; j++)
+			{
+				p[j] = mVerts[face.v[j]].pos;
+				moved[j] = face.v[j] == v ? pos : p[j];
+			}
+			
+			Vector3d before = (p[1] - p[0]).crossProduct(p[2] - p[0]);
+			Vector3d after = (moved[1] - moved[0]).crossProduct(moved[2] - moved[0]);
+			
+			double lengths = std::sqrt(before.lengthSq() * after.lengthSq());
+			if (lengths <= 0.0 || before.dotProduct(after) < xcMinNormalDot * lengths)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+	
+	void Simplifier::collapse(const Collapse& c)
+	{
+		Vertex& keep = mVerts[c.v0];
+		Vertex& gone = mVerts[c.v1];
+		
+		keep.pos = c.pos;
+		keep.normal += gone.normal;
+		keep.quadric += gone.quadric;
+		keep.version++;
+		
+		gone.removed = true;
+		
+		for (int f : gone.faces)
+		{
+			Face& face = mFaces[f];
+			if (face.removed)
+			{
+				continue;
+			}
+			
+			if (face.v[0] == c.v0 || face.v[1] == c.v0 || face.v[2] == c.v0)
+			{
+				face.removed = true;
+				mFaceCount--;
+				continue;
+			}
+			
+			for (int j = 0; j < 3; j++)
+			{
+				if (face.v[j] == c.v1)
+				{
+					face.v[j] = c.v0;
+				}
+			}
+			keep.faces.push_back(f);
+		}
+		gone.faces.clear();
+		
+		// Drop removed faces and requeue the edges around the kept vertex
+		std::vector<int> neighbours;
+		std::vector<int> faces;
+		for (int f : keep.faces)
+		{
+			const Face& face = mFaces[f];
+			if (face.removed)
+			{
+				continue;
+			}
+			faces.push_back(f);
+			
+			for (int j = 0; j < 3; j++)
+			{
+				if (face.v[j] != c.v0)
+				{
+					neighbours.push_back(face.v[j]);
+				}
+			}
+		}
+		keep.faces.swap(faces);
+		
+		std::sort(neighbours.begin(), neighbours.end());
+		neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+		for (int n : neighbours)
+		{
+			push(c.v0, n);
+		}
+	}
+	
+	void Simplifier::run(size_t targetTriangles)
+	{
+		while (mFaceCount > targetTriangles && !mQueue.empty())
+		{
+			Collapse c = mQueue.top();
+			mQueue.pop();
+			
+			const Vertex& a = mVerts[c.v0];
+			const Vertex& b = mVerts[c.v1];
+			if (a.removed || b.removed || a.version != c.version0 || b.version != c.version1)
+			{
+				// Stale, a newer entry was queued when the vertices changed
+				continue;
+			}
+			
+			if (flips(c.v0, c.v1, c.pos) || flips(c.v1, c.v0, c.pos))
+			{
+				continue;
+			}
+			
+			collapse(c);
+		}
+	}
+	
+	void Simplifier::write(Mesh& out, const Mesh& in) const
+	{
+		out = Mesh();
+		out.materials = in.materials;
+		
+		std::vector<int> triMaterials;
+		for (const auto& face : mFaces)
+		{
+			if (face.removed)
+			{
+				continue;
+			}
+			
+			const Vertex& v0 = mVerts[face.v[0]];
+			const Vertex& v1 = mVerts[face.v[1]];
+			const Vertex& v2 = mVerts[face.v[2]];
+			
+			Triangle3r tri;
+			tri.p0 = v0.pos;
+			tri.p1 = v1.pos;
+			tri.p2 = v2.pos;
+			tri.n0 = v0.normal;
+			tri.n1 = v1.normal;
+			tri.n2 = v2.normal;
+			tri.n0.normalize();
+			tri.n1.normalize();
+			tri.n2.normalize();
+			
+			out.triangles.push_back(tri);
+			triMaterials.push_back(face.material);
+		}
+		
+		out.groupByMaterial(triMaterials);
+		out.updateBounds();
+	}
+}
+
+void simplifyMesh(Mesh& out, const Mesh& in, size_t targetTriangles)
+{
+	Simplifier simplifier(in);
+	simplifier.run(targetTriangles);
+	simplifier.write(out, in);
+}
+
+MeshLod::MeshLod() :
+	mDensity(0.5),
+	mHysteresis(0.15)
+{
+}
+
+void MeshLod::generate(const Mesh& mesh, int maxLevels, double ratio, size_t minTriangles)
+{
+	mLevels.clear();
+	mLevels.reserve(maxLevels);
+	mLevels.push_back(mesh);
+	
+	while ((int)mLevels.size() < maxLevels)
+	{
+		const Mesh& prev = mLevels.back();
+		size_t target = (size_t)(prev.triangles.size() * ratio);
+		if (target < minTriangles)
+		{
+			break;
+		}
+		
+		Mesh level;
+		simplifyMesh(level, prev, target);
+		if (level.triangles.size() >= prev.triangles.size())
+		{
+			// Nothing left to collapse
+			break;
+		}
+		
+		if (!mesh.meshlets.empty())
+		{
+			level.buildMeshlets();
+		}
+		mLevels.push_back(level);
+	}
+}
+
+double MeshLod::getSwitchSize(int level) const
+{
+	return std::sqrt(mLevels[level].triangles.size() / mDensity);
+}
+
+int MeshLod::selectLevel(double screenSize, int currentLevel) const
+{
+	const int last = getLevelCount() - 1;
+	if (last < 0)
+	{
+		return -1;
+	}
+	
+	int level = currentLevel < 0 ? last : std::min(currentLevel, last);
+	
+	// Finer while the object is clearly large enough for it
+	while (level > 0 && screenSize >= getSwitchSize(level - 1) * (1.0 + mHysteresis))
+	{
+		level--;
+	}
+	
+	// Coarser while the object is clearly too small for the current level
+	while (level < last && screenSize < getSwitchSize(level) * (1.0 - mHysteresis))
+	{
+		level++;
+	}
+	
+	return level;
+}
@@ -0,0 +1,49 @@
+#ifndef MESHLOD_H
+#define MESHLOD_H
+
+#include <cstddef>
+#include <vector>
+
+#include "mesh.h"
+
+// Quadric error metric edge collapse (Garland & Heckbert).
+// Vertices are welded by position, materials of the remaining triangles
+// are kept. Stops at targetTriangles or when no valid collapse is left.
+void simplifyMesh(Mesh& out, const Mesh& in, size_t targetTriangles);
+
+// Chain of progressively simplified meshes, level 0 is the source mesh.
+// A level is picked from the projected size of the object on screen.
+class MeshLod
+{
+public:
+	MeshLod();
+	
+	// Each level keeps ratio of the previous level's triangles, generation
+	// ends at maxLevels or when a level would drop below minTriangles.
+	void generate(const Mesh& mesh, int maxLevels = 5, double ratio = 0.5, size_t minTriangles = 64);
+	
+	// References stay valid until the next generate()
+	int getLevelCount() const { return (int)mLevels.size(); }
+	const Mesh& getLevel(int level) const { return mLevels[level]; }
+	
+	// Triangles a level may have per squared pixel of projected size
+	void setTriangleDensity(double density) { mDensity = density; }
+	
+	// Fraction the projected size must move past a switch point before the
+	// level changes, keeps objects near the threshold from popping
+	void setHysteresis(double hysteresis) { mHysteresis = hysteresis; }
+	
+	// screenSize is the projected diameter in pixels, currentLevel the level
+	// selected last frame (or -1)
+	int selectLevel(double screenSize, int currentLevel) const;
+
+private:
+	std::vector<Mesh> mLevels;
+	double mDensity;
+	double mHysteresis;
+	
+	// Smallest projected size level warrants
+	double getSwitchSize(int level) const;
+};
+
+#endif
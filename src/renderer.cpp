@@ -1,72 +1,343 @@
 #include "renderer.h"
 #include "Window.h"
-#include "geometry/plane.h"
 #include "geometry/frustum.h"
+#include "shadowmap.h"
+#include "math/color.h"
+#include "math/fastmath.h"
 #include <algorithm>
+#include <limits>
 
 namespace 
 {
 	const double xcNear = 1.0;
 	const double xcFar = 1000.0;
+	const double xcFovY = 90.0; // Degrees
 	
-	uint32_t colorVecToUint(const Vector3d& color)
+	// Shading blocks are laid out in tiles of the coarsest rate
+	const int xcShadingTileSize = (int)ShadingRate::Rate4x4;
+	
+	// Light intensity considered invisible, one step of an 8-bit channel
+	const double xcLightCutoff = 1.0 / 256.0;
+	
+	// Pixels converted to sRGB per batch
+	const size_t xcPixelBatchSize = 256;
+	
+	// Cull mesh against the frustum planes, sphere first and then the box.
+	// bounds receives the global space box when the mesh is visible.
+	bool isVisible(const Frustum& frustum, const Mesh& mesh, const Matrix4d& transform, Aabb3d& bounds)
+	{
+		Vector3d center = math::transform(transform, Vector4d(mesh.center, 1.0));
+		double radius = mesh.radius * math::maxScale(transform);
+		
+		Frustum::Containment containment = frustum.classify(center, radius);
+		if (containment == Frustum::Containment::Outside)
+		{
+			return false;
+		}
+		
+		bounds = mesh.bounds.transformed(transform);
+		return containment == Frustum::Containment::Inside ||
+			   frustum.classify(bounds) != Frustum::Containment::Outside;
+	}
+	
+	// Cull meshlet against the frustum, and through its normal cone against
+	// the cull mode. eye is the frustum position in object space, where the
+	// cone test holds for any affine transform.
+	bool isVisible(const Frustum& frustum, const Meshlet& meshlet, const Matrix4d& transform,
+				   double scale, const Vector3d& eye, CullMode cullMode)
+	{
+		Vector3d center = math::transform(transform, Vector4d(meshlet.center, 1.0));
+		if (frustum.classify(center, meshlet.radius * scale) == Frustum::Containment::Outside)
+		{
+			return false;
+		}
+		
+		if (cullMode == CullMode::None)
+		{
+			return true;
+		}
+		
+		Vector3d view = meshlet.center - eye;
+		double facing = view.dotProduct(meshlet.coneAxis);
+		if (cullMode == CullMode::Front)
+		{
+			facing = -facing;
+		}
+		
+		// Culled if every face is turned away from every point of the sphere
+		return facing < meshlet.coneCutoff * view.length() + meshlet.radius;
+	}
+	
+	void normalize(Vector3r& normal, NormalizeMode mode)
+	{
+		if (mode == NormalizeMode::Exact)
+		{
+			normal.normalize();
+		}
+		else if (mode == NormalizeMode::Fast)
+		{
+			normal *= math::rsqrtFast(normal.lengthSq());
+		}
+	}
+	
+	// Viewport position of a projected corner, in the screen space of the pipeline mode
+	void toScreen(Vector3r& screen, const Vector3r& ndc, const Frustum& frustum, const Viewport& viewport)
+	{
+		screen = frustum.ndcToViewportSpace(ndc, viewport);
+	}
+	
+	void toScreen(Vector3i& screen, const Vector3r& ndc, const Frustum& frustum, const Viewport& viewport)
+	{
+		screen = frustum.ndcToFixedViewportSpace(ndc, viewport);
+	}
+	
+	// Rounds towards negative infinity, unlike integer division
+	int floorDiv(int a, int b)
+	{
+		return a >= 0 ? a / b : -((b - 1 - a) / b);
+	}
+	
+	// Fixed point depth in the viewport's depth range, exact for the default [0, 1]
+	TReal fromFixedDepth(int64_t depth, const Viewport& viewport)
+	{
+		const TReal range = viewport.getDepthFar() - viewport.getDepthNear();
+		return viewport.getDepthNear() + range * ((TReal)depth / (TReal)(1 << xcFixedDepthBits));
+	}
+	
+	// Edge function from a to b of a fixed point triangle at the pixel centers
+	// of a region, twice the signed area of the edge and the center. Exact in
+	// 64 bits for coordinates within the guard band of Frustum.
+	struct FixedEdge
+	{
+		int64_t origin;	// At the first pixel center of the region
+		int64_t stepX;	// One pixel to the right
+		int64_t stepY;	// One pixel down
+		
+		FixedEdge(const Vector3i& a, const Vector3i& b, const Vector2i& start)
+		{
+			const int64_t one = 1 << xcSubpixelBits;
+			const int64_t cx = start.x * one + one / 2;
+			const int64_t cy = start.y * one + one / 2;
+			const int64_t dx = (int64_t)b.x - a.x;
+			const int64_t dy = (int64_t)b.y - a.y;
+			origin = dx * (cy - a.y) - (cx - a.x) * dy;
+			stepX = -dy * one;
+			stepY = dx * one;
+		}
+		
+		void negate()
+		{
+			origin = -origin;
+			stepX = -stepX;
+			stepY = -stepY;
+		}
+		
+		int64_t at(int x, int y) const { return origin + x * stepX + y * stepY; }
+	};
+	
+	// Fixed point triangle set up for the raster loops. Coverage and depth
+	// are computed in integers only.
+	class FixedTriangle
+	{
+	public:
+		// area as from setupTriangle, start is the first pixel of the region
+		FixedTriangle(const Triangle3i& tri, int64_t area, const Vector2i& start) :
+			mEdge0(tri.p1, tri.p2, start),
+			mEdge1(tri.p2, tri.p0, start),
+			mArea(area),
+			mShift(0),
+			mDepth0(tri.p0.z),
+			mDepth1(tri.p1.z),
+			mDepth2(tri.p2.z)
+		{
+			// Same sign for both windings, covered pixels are non-negative
+			if (mArea < 0)
+			{
+				mEdge0.negate();
+				mEdge1.negate();
+				mArea = -mArea;
+			}
+			
+			// Weights are scaled down to 30 bits, their products with the
+			// depths then fit in 64 bits
+			while ((mArea >> mShift) >= (int64_t(1) << 30))
+			{
+				mShift++;
+			}
+			mScaledArea = mArea >> mShift;
+		}
+		
+		// Weights of pixel (x, y) relative to the region's first pixel, they
+		// sum to getScaledArea(). False if the pixel center isn't covered.
+		bool getWeights(int x, int y, int64_t& w0, int64_t& w1, int64_t& w2) const
+		{
+			const int64_t e0 = mEdge0.at(x, y);
+			const int64_t e1 = mEdge1.at(x, y);
+			if (e0 < 0 || e1 < 0 || mArea - e0 - e1 < 0)
+			{
+				return false;
+			}
+			
+			w0 = e0 >> mShift;
+			w1 = e1 >> mShift;
+			w2 = mScaledArea - w0 - w1;
+			return true;
+		}
+		
+		int64_t getScaledArea() const { return mScaledArea; }
+		
+		// Interpolated fixed point depth, rounded
+		int64_t getDepth(int64_t w0, int64_t w1, int64_t w2) const
+		{
+			return (w0 * mDepth0 + w1 * mDepth1 + w2 * mDepth2 + mScaledArea / 2) / mScaledArea;
+		}
+		
+	private:
+		FixedEdge mEdge0, mEdge1;
+		int64_t mArea;
+		int mShift;
+		int64_t mScaledArea;
+		int64_t mDepth0, mDepth1, mDepth2;
+	};
+	
+	Vector3d objectSpaceEye(const Frustum& frustum, const Matrix4d& transform)
 	{
-		return uint32_t(color.r * 0xFF) << 16 | 
-			   uint32_t(color.g * 0xFF) << 8 | 
-			   uint32_t(color.b * 0xFF); 
+		// Object transforms are affine (no projection)
+		const Matrix4d toObject = transform.inverse(MatrixKind::Affine);
+		return math::transform(toObject, Vector4d(frustum.getTransform().getPosition(), 1.0));
 	}
 	
-	uint32_t standardShader(ShaderInput& input)
+	// TMath picks the precise or fast math of math/fastmath.h
+	template<typename TMath>
+	Vector3d standardShader(ShaderInput& input)
 	{
 		// double dist = 1.0 + input.screenCoord.z;
-		// TODO:: material property
-		const double shiny = 0.2;
+		const Material& material = *input.material;
+		
+		// Lighting is done in double
+		const Vector3d vert = input.vert;
+		const Vector3d normal = input.normal;
 		
 		Vector3d color(0.0, 0.0, 0.0);
 		for (const auto& light : input.lightContext->lights)
 		{
-			Vector3d dir = light.pos - input.vert;
-			dir.normalize();
+			Vector3d dir = light.pos - vert;
+			double distSq = dir.lengthSq();
+			if (distSq > light.getRadius() * light.getRadius())
+			{
+				// Out of range
+				continue;
+			}
+			
+			double dist = TMath::sqrt(distSq);
+			dir /= dist;
 			
-			Vector3d toEye = -input.vert;
-			toEye.normalize();
+			double att = light.attenuation(dist);
+			double lit = light.shadowMap ? light.shadowMap->lookup(input.vert, dir.dotProduct(normal)) : 1.0;
 			
-			Vector3d reflect = -math::reflect(dir, input.normal);
-			reflect.normalize();
+			Vector3d toEye = -vert;
+			TMath::normalize(toEye);
 			
-			// Diffuse term
-			Vector3d diff = light.diffuse * std::max(dir.dotProduct(input.normal), 0.0);
-			math::clamp(diff, 0.0, 1.0);
+			Vector3d reflect = -math::reflect(dir, normal);
+			TMath::normalize(reflect);
 			
-			// Specular term
+			// Diffuse and specular factors
+			double diffuse = std::max(dir.dotProduct(normal), 0.0) * lit * att;
 			double f = std::max(reflect.dotProduct(toEye), 0.0);
-			Vector3d spec = light.specular * std::pow(f, shiny);
-			math::clamp(spec, 0.0, 1.0);
+			double specular = TMath::pow(f, material.shininess) * lit * att;
 			
-			color += light.ambient + diff + spec;
+			// One pass per channel instead of a chain of vector temporaries
+			for (int i = 0; i < 3; i++)
+			{
+				double diff = light.getDiffuse()[i] * material.diffuse[i] * diffuse;
+				double spec = light.getSpecular()[i] * material.specular[i] * specular;
+				math::clamp(diff, 0.0, 1.0);
+				math::clamp(spec, 0.0, 1.0);
+				
+				color[i] += light.getAmbient()[i] * material.ambient[i] * att + diff + spec;
+			}
 		}
 		
-		math::clamp(color, 0.0, 1.0);
-		
-		return colorVecToUint(color);
+		return color;
+	}
+}
+
+Light::Light() :
+	mK0(1.0),
+	mK1(0.0),
+	mK2(0.0),
+	mRadius(std::numeric_limits<double>::infinity())
+{
+}
+
+void Light::setColors(const Vector3d& ambient, const Vector3d& diffuse, const Vector3d& specular)
+{
+	mAmbient = ambient;
+	mDiffuse = diffuse;
+	mSpecular = specular;
+	updateRadius();
+}
+
+void Light::setAttenuation(double constant, double linear, double quadratic)
+{
+	mK0 = constant;
+	mK1 = linear;
+	mK2 = quadratic;
+	updateRadius();
+}
+
+void Light::updateRadius()
+{
+	// Solve for the distance where the brightest channel drops below the cutoff:
+	// k0 + k1 * d + k2 * d^2 = brightest / cutoff
+	double brightest = 0.0;
+	for (int i = 0; i < 3; i++)
+	{
+		brightest = std::max(brightest, std::max(mAmbient[i], std::max(mDiffuse[i], mSpecular[i])));
+	}
+	double c = mK0 - brightest / xcLightCutoff;
+	
+	if (c >= 0.0)
+	{
+		// Never visible
+		mRadius = 0.0;
+	}
+	else if (mK2 > 0.0)
+	{
+		mRadius = (-mK1 + std::sqrt(mK1 * mK1 - 4.0 * mK2 * c)) / (2.0 * mK2);
+	}
+	else if (mK1 > 0.0)
+	{
+		mRadius = -c / mK1;
+	}
+	else
+	{
+		mRadius = std::numeric_limits<double>::infinity();
 	}
 }
 
 Renderer::Renderer(TWindowPtr window) :
 	mWindow(window),
-	mShader(standardShader),
+	mShader(standardShader<math::PreciseMath>),
 	mViewport(std::make_shared<Viewport>(window->getWidth(), window->getHeight())),
 	mDepthCheck(true),
-	mDepthBuffer()
+	mDepthBuffer(),
+	mCullMode(CullMode::Back),
+	mShadingRate(ShadingRate::Rate1x1),
+	mPeripheryShadingRate(ShadingRate::Rate1x1),
+	mPeripheryRadius(1.0),
+	mNormalizeMode(NormalizeMode::Exact),
+	mPipelineMode(PipelineMode::Real),
+	mOcclusionCulling(false)
 {
-	mCamera = std::make_shared<Frustum>(2.0 * atan(mWindow->getHeight() / 2.0 / xcNear), mWindow->getWidth() / (double)mWindow->getHeight(), xcNear, xcFar);
+	mCamera = std::make_shared<Frustum>(xcFovY, mWindow->getWidth() / (double)mWindow->getHeight(), xcNear, xcFar);
 	
 	for (int y = 0; y < window->getHeight(); y++)
 	{
-		mDepthBuffer.push_back(std::vector<double>());
+		mDepthBuffer.push_back(std::vector<TReal>());
 		for (int x = 0; x < window->getWidth(); x++)
 		{
-			mDepthBuffer[y].push_back(-mViewport->getDepthFar());
+			mDepthBuffer[y].push_back(mViewport->getDepthFar());
 		}
 	}
 	
@@ -77,167 +348,925 @@ Renderer::Renderer(TWindowPtr window) :
 	l.pos = Vector3d(-100.0, 100.0, -50.0);
 	// l.dir = Vector3d(0.0, -1.0, 0.0);
 	
-	l.ambient = Vector3d(0.05, 0.05, 0.05);
-	l.diffuse = Vector3d(0.4, 0.4, 0.4);
-	l.specular = Vector3d(0.4, 0.2, 0.2);
+	l.setColors(Vector3d(0.05, 0.05, 0.05), Vector3d(0.4, 0.4, 0.4), Vector3d(0.4, 0.2, 0.2));
 	
 	mLightContext->lights.push_back(l);
+	
+	mDrawLights = std::make_shared<LightContext>();
+	
+	mShaders.push_back(standardShader<math::PreciseMath>);
+	mShaders.push_back(standardShader<math::FastMath>);
+	
+	mShaderInput.lightContext = mLightContext;
+	mShaderInput.material = &mDefaultMaterial;
 }
 
 Renderer::~Renderer()
 {
 }
 
+void Renderer::setPeripheryShadingRate(ShadingRate rate, double innerRadius)
+{
+	mPeripheryShadingRate = rate;
+	mPeripheryRadius = innerRadius;
+}
+
 void Renderer::clearDepthBuffer()
 {
-	double clr = -mViewport->getDepthFar();
+	TReal clr = mViewport->getDepthFar();
 	for (auto& it : mDepthBuffer)
 	{
-		std::for_each(it.begin(), it.end(), [clr](double& d){ d = clr; });
+		std::for_each(it.begin(), it.end(), [clr](TReal& d){ d = clr; });
+	}
+}
+
+void Renderer::selectLights(const Aabb3d& bounds)
+{
+	mDrawLights->lights.clear();
+	mDrawLightIndices.clear();
+	for (size_t i = 0; i < mLightContext->lights.size(); i++)
+	{
+		const Light& light = mLightContext->lights[i];
+		if (light.getRadius() == std::numeric_limits<double>::infinity() ||
+			math::intersects(bounds, light.pos, light.getRadius()))
+		{
+			mDrawLights->lights.push_back(light);
+			mDrawLightIndices.push_back(i);
+		}
+	}
+}
+
+void Renderer::selectLights(const std::vector<size_t>& indices)
+{
+	mDrawLights->lights.clear();
+	mDrawLightIndices = indices;
+	for (size_t i : indices)
+	{
+		mDrawLights->lights.push_back(mLightContext->lights[i]);
+	}
+}
+
+Renderer::TLightContextPtr Renderer::getQueuedLights()
+{
+	// Instances usually see the same lights as the one before
+	if (!mQueuedLights || mDrawLightIndices != mQueuedLightIndices)
+	{
+		mQueuedLights = std::make_shared<LightContext>(*mDrawLights);
+		mQueuedLightIndices = mDrawLightIndices;
+	}
+	return mQueuedLights;
+}
+
+Renderer::TShaderId Renderer::addShader(TShaderFunc func)
+{
+	mShaders.push_back(func);
+	return (TShaderId)mShaders.size() - 1;
+}
+
+void Renderer::submit(const Mesh& mesh, const Matrix4d& transform, TShaderId shader, ShadingRate rate)
+{
+	MeshInstance instance;
+	instance.transform = transform;
+	submitInstanced(mesh, &instance, 1, shader, rate);
+}
+
+void Renderer::submitInstanced(const Mesh& mesh, const MeshInstance* instances, size_t count, TShaderId shader,
+							   ShadingRate rate)
+{
+	const Vector3d& eye = mCamera->getTransform().getPosition();
+	
+	DrawItem item;
+	item.shader = shader;
+	item.shadingRate = rate;
+	item.mesh = &mesh;
+	for (size_t i = 0; i < count; i++)
+	{
+		const MeshInstance& instance = instances[i];
+		if (!isVisible(*mCamera, mesh, instance.transform, item.bounds))
+		{
+			continue;
+		}
+		
+		item.transform = instance.transform;
+		item.distanceSq = math::distanceSq(item.bounds, eye);
+		if (instance.lights)
+		{
+			selectLights(*instance.lights);
+		}
+		else
+		{
+			selectLights(item.bounds);
+		}
+		item.lights = getQueuedLights();
+		for (const auto& range : mesh.ranges)
+		{
+			item.material = instance.material ? instance.material : &mesh.materials[range.material];
+			item.range = &range;
+			mDrawQueue.push_back(item);
+		}
+	}
+}
+
+double Renderer::getScreenSize(const Aabb3d& box) const
+{
+	const double radius = (box.max - box.min).length() * 0.5;
+	const double dist = (box.center() - mCamera->getTransform().getPosition()).length();
+	const double height = mWindow->getHeight();
+	if (dist <= radius)
+	{
+		// Camera inside the sphere, it covers the screen
+		return height;
+	}
+	
+	// tan(fovY / 2) of the camera
+	const double tanHalfFov = mCamera->getHalfNearHeight() / mCamera->getNear();
+	return radius / (dist * tanHalfFov) * height;
+}
+
+void Renderer::flush()
+{
+	auto byState = [](const DrawItem& a, const DrawItem& b)
+	{
+		return a.shader != b.shader ? a.shader < b.shader : a.material < b.material;
+	};
+	
+	// Within a state, copies of a range follow each other front-to-back,
+	// so the range's triangles stay in cache and the depth test rejects early
+	auto byStateAndRange = [&byState](const DrawItem& a, const DrawItem& b)
+	{
+		if (a.shader != b.shader || a.material != b.material)
+		{
+			return byState(a, b);
+		}
+		return a.range != b.range ? a.range < b.range : a.distanceSq < b.distanceSq;
+	};
+	
+	if (mOcclusionCulling)
+	{
+		// Front-to-back, near (and large) occluders fill the depth buffer first.
+		// Ranges of one object stay together, ordered by state.
+		std::stable_sort(mDrawQueue.begin(), mDrawQueue.end(), [&byState](const DrawItem& a, const DrawItem& b)
+		{
+			return a.distanceSq != b.distanceSq ? a.distanceSq < b.distanceSq : byState(a, b);
+		});
+	}
+	else
+	{
+		std::stable_sort(mDrawQueue.begin(), mDrawQueue.end(), byStateAndRange);
+	}
+	
+	TShaderFunc prevShader = mShader;
+	TShaderId shader = -1;
+	const ShadingRate prevShadingRate = mShadingRate;
+	
+	// Occlusion result of the last queried object
+	const Mesh* queriedMesh = nullptr;
+	const Matrix4d* queriedTransform = nullptr;
+	bool occluded = false;
+	
+	for (const auto& item : mDrawQueue)
+	{
+		if (mOcclusionCulling)
+		{
+			if (item.mesh != queriedMesh || !queriedTransform || *queriedTransform != item.transform)
+			{
+				queriedMesh = item.mesh;
+				queriedTransform = &item.transform;
+				occluded = countVisibleSamples(item.bounds, 1) == 0;
+			}
+			
+			if (occluded)
+			{
+				continue;
+			}
+		}
+		
+		if (item.shader != shader)
+		{
+			shader = item.shader;
+			mShader = mShaders[shader];
+		}
+		
+		// The coarser of the renderer's and the draw's rate
+		mShadingRate = std::max(prevShadingRate, item.shadingRate);
+		mShaderInput.material = item.material;
+		mShaderInput.lightContext = item.lights;
+		renderRange(*item.mesh, *item.range, item.transform);
+	}
+	
+	mDrawQueue.clear();
+	mQueuedLights.reset();
+	
+	mShader = prevShader;
+	mShadingRate = prevShadingRate;
+	mShaderInput.lightContext = mLightContext;
+	mShaderInput.material = &mDefaultMaterial;
+}
+
+void Renderer::renderMesh(const Mesh& mesh, const Matrix4d& transform)
+{
+	Aabb3d bounds;
+	if (!isVisible(*mCamera, mesh, transform, bounds))
+	{
+		return;
+	}
+	
+	selectLights(bounds);
+	mShaderInput.lightContext = mDrawLights;
+	
+	for (const auto& range : mesh.ranges)
+	{
+		mShaderInput.material = &mesh.materials[range.material];
+		renderRange(mesh, range, transform);
+	}
+	
+	mShaderInput.lightContext = mLightContext;
+	mShaderInput.material = &mDefaultMaterial;
+}
+
+void Renderer::renderRange(const Mesh& mesh, const MeshRange& range, const Matrix4d& transform)
+{
+	if (range.meshletCount == 0)
+	{
+		drawTriangles(mesh, range.first, range.count, transform);
+		flushPixels();
+		return;
+	}
+	
+	const Vector3d eye = objectSpaceEye(*mCamera, transform);
+	const double scale = math::maxScale(transform);
+	for (size_t i = range.firstMeshlet; i < range.firstMeshlet + range.meshletCount; i++)
+	{
+		const Meshlet& meshlet = mesh.meshlets[i];
+		if (isVisible(*mCamera, meshlet, transform, scale, eye, mCullMode))
+		{
+			drawTriangles(mesh, meshlet.first, meshlet.count, transform);
+		}
+	}
+	flushPixels();
+}
+
+void Renderer::drawTriangles(const Mesh& mesh, size_t first, size_t count, const Matrix4d& transform)
+{
+	transformCorners(mesh, first, count, transform, *mCamera, true);
+	
+	Triangle3r global;
+	Triangle3r screenTri;
+	Triangle3i fixedTri;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (mPipelineMode == PipelineMode::FixedPoint)
+		{
+			getCorners(global, fixedTri, i, *mCamera, *mViewport);
+			drawProjected(global, fixedTri);
+		}
+		else
+		{
+			getCorners(global, screenTri, i, *mCamera, *mViewport);
+			drawProjected(global, screenTri);
+		}
+	}
+}
+
+void Renderer::transformCorners(const Mesh& mesh, size_t first, size_t count, const Matrix4d& transform,
+								const Frustum& frustum, bool normals)
+{
+	mCornerPos.resize(count * 3);
+	mCornerNormal.resize(normals ? count * 3 : 0);
+	for (size_t i = 0; i < count; i++)
+	{
+		const Triangle3r& tri = mesh.triangles[first + i];
+		mCornerPos.set(i * 3, tri.p0);
+		mCornerPos.set(i * 3 + 1, tri.p1);
+		mCornerPos.set(i * 3 + 2, tri.p2);
+		if (normals)
+		{
+			mCornerNormal.set(i * 3, tri.n0);
+			mCornerNormal.set(i * 3 + 1, tri.n1);
+			mCornerNormal.set(i * 3 + 2, tri.n2);
+		}
+	}
+	
+	const Matrix4r toGlobal(transform);
+	math::transformPoints(mCornerPos, toGlobal, mCornerPos);
+	frustum.project(mCornerPos, mCornerNdc);
+	
+	if (!normals)
+	{
+		return;
+	}
+	
+	// Rotation and uniform scale only: the rotation keeps normals unit
+	// length. Anything else needs the inverse transpose and renormalizing.
+	if (math::isConformal(transform))
+	{
+		const Matrix4r rotation(transform * (1.0 / math::maxScale(transform)));
+		math::transformNormals(mCornerNormal, rotation, mCornerNormal);
+	}
+	else
+	{
+		math::transformNormals(mCornerNormal, Matrix4r(math::normalMatrix(transform)), mCornerNormal);
+		math::normalize(mCornerNormal);
+	}
+}
+
+template<typename TScreenTri>
+void Renderer::getCorners(Triangle3r& global, TScreenTri& screenTri, size_t i,
+						  const Frustum& frustum, const Viewport& viewport) const
+{
+	Vector3r* const points[3] = { &global.p0, &global.p1, &global.p2 };
+	Vector3r* const normals[3] = { &global.n0, &global.n1, &global.n2 };
+	decltype(screenTri.p0)* const screen[3] = { &screenTri.p0, &screenTri.p1, &screenTri.p2 };
+	for (size_t j = 0; j < 3; j++)
+	{
+		const size_t corner = i * 3 + j;
+		*points[j] = mCornerPos.get(corner);
+		if (corner < mCornerNormal.size())
+		{
+			*normals[j] = mCornerNormal.get(corner);
+		}
+		
+		// Flip sign to get top left corner = [0, 0]
+		Vector3r ndc = mCornerNdc.get(corner);
+		ndc.y = -ndc.y;
+		toScreen(*screen[j], ndc, frustum, viewport);
+	}
+}
+
+int Renderer::countVisibleSamples(const Aabb3d& box, int maxSamples)
+{
+	const int width = mWindow->getWidth();
+	const int height = mWindow->getHeight();
+	
+	Box2d rect;
+	rect.p0 = Vector2d(std::numeric_limits<double>::max(), std::numeric_limits<double>::max());
+	rect.p1 = -rect.p0;
+	double nearest = std::numeric_limits<double>::max();
+	
+	const Transform& eye = mCamera->getTransform();
+	const double near = mViewport->getDepthNear();
+	for (size_t i = 0; i < 8; i++)
+	{
+		Vector3d corner = box.point(i);
+		if (!(eye.globalToLocal(corner).z < -mCamera->getNear()))
+		{
+			// Crosses the near plane, can't be projected
+			return std::min(maxSamples, width * height);
+		}
+		
+		Vector3d ndc = mCamera->project(corner);
+		ndc.y = -ndc.y;
+		Vector3d screen = mCamera->ndcToViewportSpace(ndc, *mViewport);
+		
+		rect.p0.x = std::min(rect.p0.x, screen.x);
+		rect.p0.y = std::min(rect.p0.y, screen.y);
+		rect.p1.x = std::max(rect.p1.x, screen.x);
+		rect.p1.y = std::max(rect.p1.y, screen.y);
+		nearest = std::min(nearest, std::max(screen.z, near));
+	}
+	
+	// Every pixel whose center may be covered
+	const int minX = std::max((int)std::floor(rect.p0.x), 0);
+	const int minY = std::max((int)std::floor(rect.p0.y), 0);
+	const int endX = std::min((int)std::ceil(rect.p1.x) + 1, width);
+	const int endY = std::min((int)std::ceil(rect.p1.y) + 1, height);
+	
+	int samples = 0;
+	for (int y = minY; y < endY; y++)
+	{
+		const std::vector<TReal>& row = mDepthBuffer[y];
+		for (int x = minX; x < endX; x++)
+		{
+			if (nearest <= row[x] && ++samples >= maxSamples)
+			{
+				return samples;
+			}
+		}
+	}
+	return samples;
+}
+
+void Renderer::renderShadowMesh(ShadowMap& shadowMap, const Mesh& mesh, const Matrix4d& transform)
+{
+	Aabb3d bounds;
+	if (!isVisible(shadowMap.getFrustum(), mesh, transform, bounds))
+	{
+		return;
+	}
+	
+	const Frustum& frustum = shadowMap.getFrustum();
+	const Vector3d eye = objectSpaceEye(frustum, transform);
+	const double scale = math::maxScale(transform);
+	
+	Triangle3r global;
+	Triangle3r screenTri;
+	Triangle3i fixedTri;
+	auto renderTriangles = [&](size_t first, size_t count)
+	{
+		transformCorners(mesh, first, count, transform, frustum, false);
+		for (size_t i = 0; i < count; i++)
+		{
+			if (mPipelineMode == PipelineMode::FixedPoint)
+			{
+				getCorners(global, fixedTri, i, frustum, shadowMap.getViewport());
+				drawShadowProjected(shadowMap, fixedTri);
+			}
+			else
+			{
+				getCorners(global, screenTri, i, frustum, shadowMap.getViewport());
+				drawShadowProjected(shadowMap, screenTri);
+			}
+		}
+	};
+	
+	if (mesh.meshlets.empty())
+	{
+		renderTriangles(0, mesh.triangles.size());
+		return;
+	}
+	
+	for (const auto& meshlet : mesh.meshlets)
+	{
+		if (isVisible(frustum, meshlet, transform, scale, eye, mCullMode))
+		{
+			renderTriangles(meshlet.first, meshlet.count);
+		}
 	}
 }
 
-void Renderer::renderTriangle(const Triangle3d& triangle)
+void Renderer::renderTriangle(const Triangle3r& triangle)
 {
-	Plane triPlane(triangle.p0, triangle.p1, triangle.p2);
-	if (triPlane.signedDistance(mCamera->getTransform().getPosition()) < 0.0)
+	drawTriangle(triangle);
+	flushPixels();
+}
+
+void Renderer::drawTriangle(const Triangle3r& triangle)
+{
+	if (mPipelineMode == PipelineMode::FixedPoint)
 	{
-		// Backface culling
+		Triangle3i screenTri;
+		projectToScreen(screenTri, triangle, *mCamera, *mViewport);
+		drawProjected(triangle, screenTri);
 		return;
 	}
 	
-	Triangle3d screenTri;
-	projectToScreen(screenTri, triangle);
+	Triangle3r screenTri;
+	projectToScreen(screenTri, triangle, *mCamera, *mViewport);
+	drawProjected(triangle, screenTri);
+}
+
+void Renderer::drawProjected(const Triangle3r& triangle, const Triangle3r& screenTri)
+{
+	TReal area;
+	Box2i region;
+	if (setupTriangle(screenTri, mWindow->getWidth(), mWindow->getHeight(), area, region))
+	{
+		raster(region, screenTri, triangle, area);
+	}
+}
+
+void Renderer::drawProjected(const Triangle3r& triangle, const Triangle3i& screenTri)
+{
+	int64_t area;
+	Box2i region;
+	if (setupTriangle(screenTri, mWindow->getWidth(), mWindow->getHeight(), area, region))
+	{
+		raster(region, screenTri, triangle, area);
+	}
+}
+
+void Renderer::renderShadowTriangle(ShadowMap& shadowMap, const Triangle3r& triangle)
+{
+	if (mPipelineMode == PipelineMode::FixedPoint)
+	{
+		Triangle3i screenTri;
+		projectToScreen(screenTri, triangle, shadowMap.getFrustum(), shadowMap.getViewport());
+		drawShadowProjected(shadowMap, screenTri);
+		return;
+	}
 	
+	Triangle3r screenTri;
+	projectToScreen(screenTri, triangle, shadowMap.getFrustum(), shadowMap.getViewport());
+	drawShadowProjected(shadowMap, screenTri);
+}
+
+void Renderer::drawShadowProjected(ShadowMap& shadowMap, const Triangle3r& screenTri)
+{
+	TReal area;
 	Box2i region;
-	getRasterRegion(region, screenTri);
-	raster(region, screenTri, triangle);
+	if (setupTriangle(screenTri, shadowMap.getWidth(), shadowMap.getHeight(), area, region))
+	{
+		rasterDepth(region, screenTri, shadowMap, area);
+	}
+}
+
+void Renderer::drawShadowProjected(ShadowMap& shadowMap, const Triangle3i& screenTri)
+{
+	int64_t area;
+	Box2i region;
+	if (setupTriangle(screenTri, shadowMap.getWidth(), shadowMap.getHeight(), area, region))
+	{
+		rasterDepth(region, screenTri, shadowMap, area);
+	}
+}
+
+bool Renderer::setupTriangle(const Triangle3r& screenTri, int width, int height,
+							 TReal& area, Box2i& region) const
+{
+	// Screen y points down, which flips the winding of front faces
+	area = (screenTri.p2.x - screenTri.p1.x) * (screenTri.p0.y - screenTri.p1.y) -
+		   (screenTri.p0.x - screenTri.p1.x) * (screenTri.p2.y - screenTri.p1.y);
+	
+	bool facing;
+	switch (mCullMode)
+	{
+	case CullMode::Back:
+		facing = area < 0.0;
+		break;
+	case CullMode::Front:
+		facing = area > 0.0;
+		break;
+	default:
+		facing = area != 0.0;
+		break;
+	}
+	
+	// Slivers and sub-pixel triangles between pixel centers end up here
+	return facing && getRasterRegion(region, screenTri, width, height);
+}
+
+bool Renderer::setupTriangle(const Triangle3i& screenTri, int width, int height,
+							 int64_t& area, Box2i& region) const
+{
+	// Same as the real version, in exact integers
+	area = ((int64_t)screenTri.p2.x - screenTri.p1.x) * ((int64_t)screenTri.p0.y - screenTri.p1.y) -
+		   ((int64_t)screenTri.p0.x - screenTri.p1.x) * ((int64_t)screenTri.p2.y - screenTri.p1.y);
+	
+	bool facing;
+	switch (mCullMode)
+	{
+	case CullMode::Back:
+		facing = area < 0;
+		break;
+	case CullMode::Front:
+		facing = area > 0;
+		break;
+	default:
+		facing = area != 0;
+		break;
+	}
+	
+	return facing && getRasterRegion(region, screenTri, width, height);
 }
 
-void Renderer::projectToScreen(Triangle3d& screenTri, const Triangle3d& triangle)
+template<typename TScreenTri>
+void Renderer::projectToScreen(TScreenTri& screenTri, const Triangle3r& triangle,
+							   const Frustum& frustum, const Viewport& viewport)
 {
-	Vector3d p0 = mCamera->project(triangle.p0);
-	p0.y = -p0.y; // Flip sign to get top left corner = [0, 0]
-	screenTri.p0 = mCamera->ndcToViewportSpace(p0, *mViewport);
+	Vector3r ndc[3] = { triangle.p0, triangle.p1, triangle.p2 };
+	frustum.project(ndc, ndc, 3);
 	
-	Vector3d p1 = mCamera->project(triangle.p1);
-	p1.y = -p1.y;
-	screenTri.p1 = mCamera->ndcToViewportSpace(p1, *mViewport);
+	// Flip sign to get top left corner = [0, 0]
+	ndc[0].y = -ndc[0].y;
+	ndc[1].y = -ndc[1].y;
+	ndc[2].y = -ndc[2].y;
 	
-	Vector3d p2 = mCamera->project(triangle.p2);
-	p2.y = -p2.y;
-	screenTri.p2 = mCamera->ndcToViewportSpace(p2, *mViewport);
+	toScreen(screenTri.p0, ndc[0], frustum, viewport);
+	toScreen(screenTri.p1, ndc[1], frustum, viewport);
+	toScreen(screenTri.p2, ndc[2], frustum, viewport);
 }
 
-bool Renderer::isInsideBoundries(const Vector3d& pt)
+bool Renderer::isInsideBoundries(const Vector3r& pt)
 {
 	return pt.x > 0 && pt.x < mWindow->getWidth() &&
 		   pt.y > 0 && pt.y < mWindow->getHeight();
 }
 
-bool Renderer::isInsideBoundries(const Triangle3d& screenTri)
+bool Renderer::isInsideBoundries(const Triangle3r& screenTri)
 {
 	return isInsideBoundries(screenTri.p0) ||
 		   isInsideBoundries(screenTri.p1) ||
 		   isInsideBoundries(screenTri.p2);
 }
 
-void Renderer::getRasterRegion(Box2i& region, const Triangle3d& screenTri)
+bool Renderer::getRasterRegion(Box2i& region, const Triangle3r& screenTri, int width, int height) const
 {
-	region.p0.x = (int)std::min(screenTri.p0.x, std::min(screenTri.p1.x, screenTri.p2.x));
-	region.p0.y = (int)std::min(screenTri.p0.y, std::min(screenTri.p1.y, screenTri.p2.y));
+	double minX = std::min(screenTri.p0.x, std::min(screenTri.p1.x, screenTri.p2.x));
+	double minY = std::min(screenTri.p0.y, std::min(screenTri.p1.y, screenTri.p2.y));
+	double maxX = std::max(screenTri.p0.x, std::max(screenTri.p1.x, screenTri.p2.x));
+	double maxY = std::max(screenTri.p0.y, std::max(screenTri.p1.y, screenTri.p2.y));
+	
+	// Pixel x is sampled at x + 0.5, clamp before converting to int
+	region.p0.x = (int)std::ceil(std::max(minX - 0.5, 0.0));
+	region.p0.y = (int)std::ceil(std::max(minY - 0.5, 0.0));
+	region.p1.x = (int)std::floor(std::min(maxX - 0.5, width - 1.0));
+	region.p1.y = (int)std::floor(std::min(maxY - 0.5, height - 1.0));
+	
+	return region.p0.x <= region.p1.x && region.p0.y <= region.p1.y;
+}
+
+bool Renderer::getRasterRegion(Box2i& region, const Triangle3i& screenTri, int width, int height) const
+{
+	int minX = std::min(screenTri.p0.x, std::min(screenTri.p1.x, screenTri.p2.x));
+	int minY = std::min(screenTri.p0.y, std::min(screenTri.p1.y, screenTri.p2.y));
+	int maxX = std::max(screenTri.p0.x, std::max(screenTri.p1.x, screenTri.p2.x));
+	int maxY = std::max(screenTri.p0.y, std::max(screenTri.p1.y, screenTri.p2.y));
+	
+	// Pixel x is sampled at subpixel x * one + half
+	const int one = 1 << xcSubpixelBits;
+	const int half = one / 2;
+	region.p0.x = std::max(-floorDiv(half - minX, one), 0);
+	region.p0.y = std::max(-floorDiv(half - minY, one), 0);
+	region.p1.x = std::min(floorDiv(maxX - half, one), width - 1);
+	region.p1.y = std::min(floorDiv(maxY - half, one), height - 1);
 	
-	region.p1.x = (int)std::ceil(std::max(screenTri.p0.x, std::max(screenTri.p1.x, screenTri.p2.x)));
-	region.p1.y = (int)std::ceil(std::max(screenTri.p0.y, std::max(screenTri.p1.y, screenTri.p2.y)));
+	return region.p0.x <= region.p1.x && region.p0.y <= region.p1.y;
 }
 
 template<typename T>
-static inline T barycentricWeight(const Vector3d& bc, const T& c0, const T& c1, const T& c2)
+static inline T barycentricWeight(const Vector3r& bc, const T& c0, const T& c1, const T& c2)
 {
 	return c0 * bc.x + c1 * bc.y + c2 * bc.z;
 }
 
-void Renderer::raster(const Box2i& region, const Triangle3d& screenTri, const Triangle3d& triangle)
+// Per component, without the vector temporaries of the generic version
+template<typename T>
+static inline Vector3<T> barycentricWeight(const Vector3r& bc, const Vector3<T>& c0, const Vector3<T>& c1, const Vector3<T>& c2)
+{
+	return Vector3<T>(c0.x * bc.x + c1.x * bc.y + c2.x * bc.z,
+					  c0.y * bc.x + c1.y * bc.y + c2.y * bc.z,
+					  c0.z * bc.x + c1.z * bc.y + c2.z * bc.z);
+}
+
+int Renderer::getShadingRate(int tileX, int tileY) const
+{
+	int rate = (int)mShadingRate;
+	if ((int)mPeripheryShadingRate <= rate)
+	{
+		return rate;
+	}
+	
+	// Tile center, relative to the half screen size
+	double halfWidth = mWindow->getWidth() / 2.0;
+	double halfHeight = mWindow->getHeight() / 2.0;
+	double dx = (tileX + xcShadingTileSize / 2.0 - halfWidth) / halfWidth;
+	double dy = (tileY + xcShadingTileSize / 2.0 - halfHeight) / halfHeight;
+	
+	if (dx * dx + dy * dy > mPeripheryRadius * mPeripheryRadius)
+	{
+		rate = (int)mPeripheryShadingRate;
+	}
+	return rate;
+}
+
+template<typename TSample>
+void Renderer::walkRegion(const Box2i& region, TSample& sample)
 {
-	const int minY = std::max(region.p0.y, 0);
-	const int endY = std::min(region.p1.y + 1, mWindow->getHeight());
-	const int minX = std::max(region.p0.x, 0);
-	const int endX = std::min(region.p1.x + 1, mWindow->getWidth());
+	const int minY = region.p0.y;
+	const int endY = region.p1.y + 1;
+	const int minX = region.p0.x;
+	const int endX = region.p1.x + 1;
 	
-	ShaderInput shaderInput;
-	shaderInput.lightContext = mLightContext;
+	const bool fullRate = mShadingRate == ShadingRate::Rate1x1 && mPeripheryShadingRate == ShadingRate::Rate1x1;
 	
+	if (fullRate)
+	{
+		for (int y = minY; y < endY; y++)
+		{
+			for (int x = minX; x < endX; x++)
+			{
+				bool shaded = false;
+				Vector3d color;
+				sample(x, y, shaded, color);
+			}
+		}
+		return;
+	}
+	
+	// Walk tiles aligned to the coarsest shading rate, so blocks of
+	// different rates never overlap.
+	const int tileMask = ~(xcShadingTileSize - 1);
+	for (int tileY = minY & tileMask; tileY < endY; tileY += xcShadingTileSize)
+	{
+		for (int tileX = minX & tileMask; tileX < endX; tileX += xcShadingTileSize)
+		{
+			const int rate = getShadingRate(tileX, tileY);
+			
+			for (int blockY = tileY; blockY < tileY + xcShadingTileSize; blockY += rate)
+			{
+				for (int blockX = tileX; blockX < tileX + xcShadingTileSize; blockX += rate)
+				{
+					bool shaded = false;
+					Vector3d color;
+					
+					const int blockEndY = std::min(blockY + rate, endY);
+					const int blockEndX = std::min(blockX + rate, endX);
+					for (int y = std::max(blockY, minY); y < blockEndY; y++)
+					{
+						for (int x = std::max(blockX, minX); x < blockEndX; x++)
+						{
+							sample(x, y, shaded, color);
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+void Renderer::shadeSample(int x, int y, const Vector3r& bc, TReal depth, const Triangle3r& triangle,
+						   bool& shaded, Vector3d& color)
+{
+	// Depth check
+	if (mDepthCheck && depth > mDepthBuffer[y][x])
+	{
+		return;
+	}
+	
+	// Fill depth buffer
+	mDepthBuffer[y][x] = depth;
+	
+	if (!shaded)
+	{
+		// TODO: Project 3d-coord
+		// TODO: Texture coord
+		// At the pixel center
+		mShaderInput.screenCoord = Vector3r((TReal)x + (TReal)0.5, (TReal)y + (TReal)0.5, depth);
+		mShaderInput.vert = barycentricWeight(bc, triangle.p0, triangle.p1, triangle.p2);
+		mShaderInput.normal = barycentricWeight(bc, triangle.n0, triangle.n1, triangle.n2);
+		normalize(mShaderInput.normal, mNormalizeMode);
+		color = mShader(mShaderInput);
+		shaded = true;
+	}
+	
+	rasterPixel(x, y, color);
+}
+
+void Renderer::raster(const Box2i& region, const Triangle3r& screenTri, const Triangle3r& triangle,
+					  TReal area)
+{
 	// For barycentric calculations
-	double x01 = screenTri.p0.x - screenTri.p1.x;
-	double x02 = screenTri.p0.x - screenTri.p2.x;
-	double x10 = screenTri.p1.x - screenTri.p0.x;
-	double x21 = screenTri.p2.x - screenTri.p1.x;
+	TReal x02 = screenTri.p0.x - screenTri.p2.x;
+	TReal x21 = screenTri.p2.x - screenTri.p1.x;
+	
+	TReal y02 = screenTri.p0.y - screenTri.p2.y;
+	TReal y21 = screenTri.p2.y - screenTri.p1.y;
+	
+	const TReal invArea = 1 / area;
+	
+	// Coverage and depth of a single pixel. The shader only runs for the
+	// first covered pixel of a block, the others reuse its color.
+	auto rasterSample = [&](int x, int y, bool& shaded, Vector3d& color)
+	{
+		// Add a half, to adjust for the center of the pixel.
+		// Screen coordinate (0, 0) is actually (0.5, 0.5)
+		Vector2r coord((TReal)x + (TReal)0.5, (TReal)y + (TReal)0.5);
+		
+		// Barycentric coordinates
+		Vector3r bc;
+		bc.x = (x21 * (coord.y - screenTri.p1.y) - (coord.x - screenTri.p1.x) * y21) * invArea;
+		if (bc.x < 0.0 || bc.x > 1.0)
+		{
+			// Not inside triangle
+			return;
+		}
+		
+		bc.y = (x02 * (coord.y - screenTri.p2.y) - (coord.x - screenTri.p2.x) * y02) * invArea;
+		if (bc.y < 0.0 || bc.y > 1.0)
+		{
+			// Not inside triangle
+			return;
+		} 
+		
+		bc.z = 1 - bc.x - bc.y;
+		if (bc.z < 0.0 || bc.z > 1.0)
+		{
+			// Not inside triangle
+			return;
+		} 
+		
+		// Interpolate depth from barycentric coods.
+		TReal depth = barycentricWeight(bc, screenTri.p0.z, screenTri.p1.z, screenTri.p2.z);
+		shadeSample(x, y, bc, depth, triangle, shaded, color);
+	};
+	
+	walkRegion(region, rasterSample);
+}
+
+void Renderer::raster(const Box2i& region, const Triangle3i& screenTri, const Triangle3r& triangle,
+					  int64_t area)
+{
+	const FixedTriangle fixedTri(screenTri, area, region.p0);
+	const TReal invArea = 1 / (TReal)fixedTri.getScaledArea();
+	
+	// Coverage and depth in integers, only the interpolants for the
+	// shader go back to TReal
+	auto rasterSample = [&](int x, int y, bool& shaded, Vector3d& color)
+	{
+		int64_t w0, w1, w2;
+		if (!fixedTri.getWeights(x - region.p0.x, y - region.p0.y, w0, w1, w2))
+		{
+			// Not inside triangle
+			return;
+		}
+		
+		const TReal depth = fromFixedDepth(fixedTri.getDepth(w0, w1, w2), *mViewport);
+		const Vector3r bc((TReal)w0 * invArea, (TReal)w1 * invArea, (TReal)w2 * invArea);
+		shadeSample(x, y, bc, depth, triangle, shaded, color);
+	};
+	
+	walkRegion(region, rasterSample);
+}
+
+void Renderer::rasterDepth(const Box2i& region, const Triangle3r& screenTri, ShadowMap& shadowMap, TReal area)
+{
+	const int minY = region.p0.y;
+	const int endY = region.p1.y + 1;
+	const int minX = region.p0.x;
+	const int endX = region.p1.x + 1;
 	
-	double y01 = screenTri.p0.y - screenTri.p1.y;
-	double y02 = screenTri.p0.y - screenTri.p2.y;
-	double y10 = screenTri.p1.y - screenTri.p0.y;
-	double y21 = screenTri.p2.y - screenTri.p1.y;
+	// Same setup as raster, but only depth is interpolated
+	TReal x02 = screenTri.p0.x - screenTri.p2.x;
+	TReal x21 = screenTri.p2.x - screenTri.p1.x;
 	
-	double denom = x21 * y01 - x01 * y21;
+	TReal y02 = screenTri.p0.y - screenTri.p2.y;
+	TReal y21 = screenTri.p2.y - screenTri.p1.y;
+	
+	const TReal invArea = 1 / area;
 	
 	for (int y = minY; y < endY; y++)
 	{
 		for (int x = minX; x < endX; x++)
 		{
-			// Add a half, to adjust for the center of the pixel.
-			// Screen coordinate (0, 0) is actually (0.5, 0.5)
-			Vector2d coord((double)x + 0.5, (double)y + 0.5);
+			TReal cx = (TReal)x + (TReal)0.5;
+			TReal cy = (TReal)y + (TReal)0.5;
 			
-			// Barycentric coordinates
-			Vector3d bc;
-			bc.x = (x21 * (coord.y - screenTri.p1.y) - (coord.x - screenTri.p1.x) * y21) / denom;
-			if (bc.x < 0.0 || bc.x > 1.0)
+			TReal b0 = (x21 * (cy - screenTri.p1.y) - (cx - screenTri.p1.x) * y21) * invArea;
+			TReal b1 = (x02 * (cy - screenTri.p2.y) - (cx - screenTri.p2.x) * y02) * invArea;
+			TReal b2 = 1 - b0 - b1;
+			if (b0 < 0.0 || b1 < 0.0 || b2 < 0.0)
 			{
 				// Not inside triangle
 				continue;
 			}
 			
-			bc.y = (x02 * (coord.y - screenTri.p2.y) - (coord.x - screenTri.p2.x) * y02) / denom;
-			if (bc.y < 0.0 || bc.y > 1.0)
+			float depth = (float)(screenTri.p0.z * b0 + screenTri.p1.z * b1 + screenTri.p2.z * b2);
+			float& stored = shadowMap.depthAt(x, y);
+			if (depth < stored)
 			{
-				// Not inside triangle
-				continue;
-			} 
-			
-			bc.z = 1.0 - bc.x - bc.y;
-			if (bc.z < 0.0 || bc.z > 1.0)
+				stored = depth;
+			}
+		}
+	}
+}
+
+void Renderer::rasterDepth(const Box2i& region, const Triangle3i& screenTri, ShadowMap& shadowMap, int64_t area)
+{
+	const FixedTriangle fixedTri(screenTri, area, region.p0);
+	
+	for (int y = region.p0.y; y <= region.p1.y; y++)
+	{
+		for (int x = region.p0.x; x <= region.p1.x; x++)
+		{
+			int64_t w0, w1, w2;
+			if (!fixedTri.getWeights(x - region.p0.x, y - region.p0.y, w0, w1, w2))
 			{
 				// Not inside triangle
 				continue;
-			} 
-			
-			// Interpolate depth from barycentric coods.
-			double depth = barycentricWeight(bc, screenTri.p0.z, screenTri.p1.z, screenTri.p2.z);
+			}
 			
-			// Depth check
-			if (mDepthCheck && depth < mDepthBuffer[y][x])
+			float depth = (float)fromFixedDepth(fixedTri.getDepth(w0, w1, w2), shadowMap.getViewport());
+			float& stored = shadowMap.depthAt(x, y);
+			if (depth < stored)
 			{
-				continue;
+				stored = depth;
 			}
-			
-			// Fill depth buffer
-			mDepthBuffer[y][x] = depth;
-			
-			// TODO: Project 3d-coord
-			// TODO: Texture coord
-			shaderInput.screenCoord = Vector3d(coord.x, coord.y, depth);
-			shaderInput.vert = barycentricWeight(bc, triangle.p0, triangle.p1, triangle.p2);
-			shaderInput.normal = barycentricWeight(bc, triangle.n0, triangle.n1, triangle.n2);
-			shaderInput.normal.normalize();
-			rasterPixel(shaderInput);
 		}
 	}
 }
 
-void Renderer::rasterPixel(ShaderInput& shaderInput)
+void Renderer::rasterPixel(int x, int y, const Vector3d& color)
 {
-	uint32_t color = mShader(shaderInput);
+	mPixelBatch.push_back(Vector2i(x, y));
+	mColorBatch.push_back(color);
+	
+	if (mPixelBatch.size() >= xcPixelBatchSize)
+	{
+		flushPixels();
+	}
+}
+
+void Renderer::flushPixels()
+{
+	mPackedBatch.resize(mColorBatch.size());
+	math::linearToSrgb(mColorBatch.data(), mPackedBatch.data(), mColorBatch.size());
+	
 	// TODO: Blend func
+	for (size_t i = 0; i < mPixelBatch.size(); i++)
+	{
+		mWindow->putPixel(mPixelBatch[i].x, mPixelBatch[i].y, mPackedBatch[i]);
+	}
 	
-	mWindow->putPixel(shaderInput.screenCoord.x, shaderInput.screenCoord.y, color);
+	mPixelBatch.clear();
+	mColorBatch.clear();
 }
\ No newline at end of file
@@ -2,6 +2,8 @@
 #define RENDERER_H
 
 #include <cstdint>
+#include <functional>
+#include <limits>
 #include <memory>
 #include <vector>
 
@@ -9,19 +11,50 @@
 #include "math/common.h"
 #include "geometry/frustum.h"
 #include "geometry/viewport.h"
+#include "material.h"
+#include "mesh.h"
 
 class Window;
+class ShadowMap;
 
-struct Light
+// Point light. The colors and attenuation decide the light's range, so
+// they are only set through setters that keep the radius in sync.
+class Light
 {
-	Vector3d ambient;
-	Vector3d diffuse;
-	Vector3d specular;
+public:
+	Light();
 	
 	Vector3d pos;
 	
-	// Constant, linear and quadratic attenuation parameters.
-	//double k0, k1, k2;
+	// Optional, lights without a shadow map cast no shadows
+	std::shared_ptr<ShadowMap> shadowMap;
+	
+	void setColors(const Vector3d& ambient, const Vector3d& diffuse, const Vector3d& specular);
+	const Vector3d& getAmbient() const { return mAmbient; }
+	const Vector3d& getDiffuse() const { return mDiffuse; }
+	const Vector3d& getSpecular() const { return mSpecular; }
+	
+	// Constant, linear and quadratic attenuation parameters
+	void setAttenuation(double constant, double linear, double quadratic);
+	
+	double attenuation(double dist) const
+	{
+		return 1.0 / (mK0 + mK1 * dist + mK2 * dist * dist);
+	}
+	
+	// Distance where the light no longer contributes visibly,
+	// infinite for lights without attenuation.
+	double getRadius() const { return mRadius; }
+	
+private:
+	Vector3d mAmbient;
+	Vector3d mDiffuse;
+	Vector3d mSpecular;
+	
+	double mK0, mK1, mK2;
+	double mRadius;
+	
+	void updateRadius();
 };
 
 struct LightContext
@@ -29,50 +62,186 @@ struct LightContext
 	std::vector<Light> lights;
 };
 
+// Interpolants are in the pipeline precision, see math/precision.h
 struct ShaderInput
 {
 	// 3d point in eye space
-	Vector3d vert;
+	Vector3r vert;
 	
 	// Normal in eye space
-	Vector3d normal;
+	Vector3r normal;
 	
 	// Texture coordinate
 	Vector2i texCoord;
 	
+	// Material of the current draw
+	const Material* material;
+	
 	// Screen coordinate (pixel on screen, including depth value)
-	Vector3d screenCoord;
+	Vector3r screenCoord;
 	
 	// The light context
 	std::shared_ptr<LightContext> lightContext;
 };
 
+// Number of pixels (rate x rate) sharing one shader invocation
+enum class ShadingRate
+{
+	Rate1x1 = 1,
+	Rate2x2 = 2,
+	Rate4x4 = 4
+};
+
+// Which triangles to discard, by winding on screen.
+// Front faces are counter clockwise in global space, seen from the camera.
+enum class CullMode
+{
+	None,
+	Back,
+	Front
+};
+
+// How the interpolated normal is renormalized before shading
+enum class NormalizeMode
+{
+	Off,	// Used as interpolated, short between diverging vertex normals
+	Fast,	// Approximate reciprocal square root
+	Exact
+};
+
+// Number format of projected triangles, from the screen mapping through
+// triangle setup and rasterization
+enum class PipelineMode
+{
+	Real,		// TReal, see math/precision.h
+	FixedPoint	// Integer setup on a subpixel grid, bit identical everywhere
+};
+
+// One copy of a mesh in an instanced draw
+struct MeshInstance
+{
+	MeshInstance() : material(nullptr), lights(nullptr) {}
+	
+	Matrix4d transform;
+	
+	// Replaces the mesh's own materials when set
+	const Material* material;
+	
+	// Indices of the lights reaching the instance in ascending order, e.g.
+	// from Scene::query over each light's range. When null every light is
+	// tested against the instance's bounds.
+	const std::vector<size_t>* lights;
+};
+
 class Renderer
 {
 public:
 	using TWindowPtr = std::shared_ptr<Window>;
-	using TShaderFunc = std::function<uint32_t(ShaderInput&)>;
+	// Shaders return linear color, conversion to sRGB is done by the renderer
+	using TShaderFunc = std::function<Vector3d(ShaderInput&)>;
 	using TLightContextPtr = std::shared_ptr<LightContext>;
 	using TFrustumPtr = std::shared_ptr<Frustum>;
 	using TViewportPtr = std::shared_ptr<Viewport>;
+	using TShaderId = int;
 	
 	Renderer(TWindowPtr window);
 	~Renderer();
 	
 	TFrustumPtr getCamera() { return mCamera; }
 	TViewportPtr getViewport() { return mViewport; }
+	TLightContextPtr getLightContext() { return mLightContext; }
 	
 	void setShader(TShaderFunc func) { mShader = func; }
 	
+	// Register a shader for queued draws. Shader 0 is the standard shader,
+	// shader 1 the same with the fast approximate math of math/fastmath.h.
+	TShaderId addShader(TShaderFunc func);
+	
 	void setDepthCheck(bool depthCheck) { mDepthCheck = depthCheck; }
 	
+	// Applies to both color and shadow passes, default is back face culling
+	void setCullMode(CullMode mode) { mCullMode = mode; }
+	CullMode getCullMode() const { return mCullMode; }
+	
+	// Coarse shading, the shader runs once per block and the result is
+	// broadcast to the covered pixels. Depth is still tested per pixel.
+	void setShadingRate(ShadingRate rate) { mShadingRate = rate; }
+	ShadingRate getShadingRate() const { return mShadingRate; }
+	
+	// Pixels outside an ellipse centered on screen are shaded at (at least) rate.
+	// The radius is relative to the half screen size, 1.0 touches the edges.
+	void setPeripheryShadingRate(ShadingRate rate, double innerRadius);
+	
+	// Per pixel normal normalization, default is Exact
+	void setNormalizeMode(NormalizeMode mode) { mNormalizeMode = mode; }
+	NormalizeMode getNormalizeMode() const { return mNormalizeMode; }
+	
+	// Applies to both color and shadow passes, default is Real
+	void setPipelineMode(PipelineMode mode) { mPipelineMode = mode; }
+	PipelineMode getPipelineMode() const { return mPipelineMode; }
+	
 	void clearDepthBuffer();
 	
+	// Conservatively count the depth buffer samples where the box (in global
+	// space) could be visible, by testing its screen rectangle at its nearest
+	// depth. Nothing is written. Boxes crossing the near plane count as
+	// visible everywhere. Counting stops once maxSamples is reached.
+	int countVisibleSamples(const Aabb3d& box, int maxSamples = std::numeric_limits<int>::max());
+	
+	// Projected diameter in pixels of the box's bounding sphere, as seen by
+	// the camera. Used to pick detail levels.
+	double getScreenSize(const Aabb3d& box) const;
+	
+	// Let flush() draw the queue front-to-back and skip draws whose bounds
+	// fail an occlusion query against what has been drawn so far.
+	void setOcclusionCulling(bool enabled) { mOcclusionCulling = enabled; }
+	
+	// Queue mesh for rendering. Nothing is drawn until flush(), which sorts
+	// the queue by shader and material so state is only set once per batch.
+	// The mesh must stay alive until then, the lights reaching it are
+	// selected here. The draw is shaded at least at rate, e.g. coarser for
+	// distant objects, or at the renderer's rate if that is coarser.
+	void submit(const Mesh& mesh, const Matrix4d& transform, TShaderId shader = 0,
+				ShadingRate rate = ShadingRate::Rate1x1);
+	
+	// Queue count copies of mesh. Instances are culled one by one, the
+	// queue then draws them grouped per range and front-to-back.
+	void submitInstanced(const Mesh& mesh, const MeshInstance* instances, size_t count, TShaderId shader = 0,
+						 ShadingRate rate = ShadingRate::Rate1x1);
+	void flush();
+	
+	// Render mesh to buffers. Meshes outside the view frustum are culled
+	// and lights that can't reach the mesh are skipped.
+	void renderMesh(const Mesh& mesh, const Matrix4d& transform);
+	void renderShadowMesh(ShadowMap& shadowMap, const Mesh& mesh, const Matrix4d& transform);
+	
 	// Render triangle to buffers
-	void renderTriangle(const Triangle3d& triangle);
+	void renderTriangle(const Triangle3r& triangle);
+	
+	// Render triangle depth only, into the shadow map. No shader is invoked.
+	void renderShadowTriangle(ShadowMap& shadowMap, const Triangle3r& triangle);
 	
 private:
-	using TDepthBuffer = std::vector<std::vector<double>>;
+	using TDepthBuffer = std::vector<std::vector<TReal>>;
+	
+	struct DrawItem
+	{
+		TShaderId shader;
+		ShadingRate shadingRate;
+		const Material* material;
+		const Mesh* mesh;
+		const MeshRange* range;
+		Matrix4d transform;
+		
+		// Global space
+		Aabb3d bounds;
+		
+		// Squared distance from the camera to the bounds
+		double distanceSq;
+		
+		// Lights reaching the bounds, shared by the ranges of an instance
+		TLightContextPtr lights;
+	};
 	
 	TWindowPtr mWindow;
 	TShaderFunc mShader;
@@ -84,18 +253,114 @@ private:
 	bool mDepthCheck;
 	TDepthBuffer mDepthBuffer;
 	
+	CullMode mCullMode;
+	ShadingRate mShadingRate;
+	ShadingRate mPeripheryShadingRate;
+	double mPeripheryRadius;
+	NormalizeMode mNormalizeMode;
+	PipelineMode mPipelineMode;
+	
 	// Light context
 	TLightContextPtr mLightContext;
 	
-	void projectToScreen(Triangle3d& screenTri, const Triangle3d& triangle);
+	// Lights reaching the current draw, subset of mLightContext, and
+	// their indices in it
+	TLightContextPtr mDrawLights;
+	std::vector<size_t> mDrawLightIndices;
+	
+	// Last light set handed to a queued draw and its light indices,
+	// reused while the next instances see the same lights
+	TLightContextPtr mQueuedLights;
+	std::vector<size_t> mQueuedLightIndices;
+	
+	std::vector<TShaderFunc> mShaders;
+	std::vector<DrawItem> mDrawQueue;
+	bool mOcclusionCulling;
+	
+	// Per draw shader state, set up once per batch rather than per triangle
+	ShaderInput mShaderInput;
+	Material mDefaultMaterial;
+	
+	void selectLights(const Aabb3d& bounds);
+	void selectLights(const std::vector<size_t>& indices);
+	
+	// Light set of the last selectLights for a queued draw
+	TLightContextPtr getQueuedLights();
+	void renderRange(const Mesh& mesh, const MeshRange& range, const Matrix4d& transform);
+	void drawTriangles(const Mesh& mesh, size_t first, size_t count, const Matrix4d& transform);
+	
+	// Corners of the triangles being drawn, three per triangle, as streams
+	// for the batch kernels. Positions and normals are in global space,
+	// mCornerNdc holds the projected positions. Normals go through the
+	// normal matrix and stay unit length.
+	Vector3Arrayr mCornerPos;
+	Vector3Arrayr mCornerNormal;
+	Vector3Arrayr mCornerNdc;
+	
+	// Fill the corner streams from triangles [first, first + count) of mesh
+	void transformCorners(const Mesh& mesh, size_t first, size_t count, const Matrix4d& transform,
+						  const Frustum& frustum, bool normals);
+	
+	// Triangle i of the corner streams, screenTri is Triangle3r or the fixed
+	// point Triangle3i. Global normals are only set if they were transformed.
+	template<typename TScreenTri>
+	void getCorners(Triangle3r& global, TScreenTri& screenTri, size_t i,
+					const Frustum& frustum, const Viewport& viewport) const;
+	
+	template<typename TScreenTri>
+	void projectToScreen(TScreenTri& screenTri, const Triangle3r& triangle,
+						 const Frustum& frustum, const Viewport& viewport);
+	
+	bool isInsideBoundries(const Vector3r& pt);
+	bool isInsideBoundries(const Triangle3r& screenTri);
+	
+	// Pixels whose centers may be covered, clamped to width x height.
+	// Returns false if no pixel center lies within the triangle's bounds.
+	bool getRasterRegion(Box2i& region, const Triangle3r& screenTri, int width, int height) const;
+	bool getRasterRegion(Box2i& region, const Triangle3i& screenTri, int width, int height) const;
+	
+	// Area and raster region of a projected triangle. area is twice the
+	// signed screen space area, negative for front faces. Returns false if
+	// the triangle is culled, degenerate or covers no pixel center.
+	bool setupTriangle(const Triangle3r& screenTri, int width, int height,
+					   TReal& area, Box2i& region) const;
+	// Same in fixed point, area is in squared subpixels and exact
+	bool setupTriangle(const Triangle3i& screenTri, int width, int height,
+					   int64_t& area, Box2i& region) const;
+	
+	// Render triangle to buffers, pixels may stay batched
+	void drawTriangle(const Triangle3r& triangle);
+	void drawProjected(const Triangle3r& triangle, const Triangle3r& screenTri);
+	void drawProjected(const Triangle3r& triangle, const Triangle3i& screenTri);
+	void drawShadowProjected(ShadowMap& shadowMap, const Triangle3r& screenTri);
+	void drawShadowProjected(ShadowMap& shadowMap, const Triangle3i& screenTri);
+	
+	void raster(const Box2i& region, const Triangle3r& screenTri, const Triangle3r& triangle,
+				TReal area);
+	void raster(const Box2i& region, const Triangle3i& screenTri, const Triangle3r& triangle,
+				int64_t area);
+	void rasterDepth(const Box2i& region, const Triangle3r& screenTri, ShadowMap& shadowMap, TReal area);
+	void rasterDepth(const Box2i& region, const Triangle3i& screenTri, ShadowMap& shadowMap, int64_t area);
+	
+	// Visit the pixels of region in shading blocks, sample(x, y, shaded, color)
+	// tests coverage and passes on to shadeSample
+	template<typename TSample>
+	void walkRegion(const Box2i& region, TSample& sample);
+	
+	// Depth test and write a covered pixel, run the shader unless the block
+	// is already shaded and queue the pixel. bc are its barycentric coordinates.
+	void shadeSample(int x, int y, const Vector3r& bc, TReal depth, const Triangle3r& triangle,
+					 bool& shaded, Vector3d& color);
 	
-	bool isInsideBoundries(const Vector3d& pt);
-	bool isInsideBoundries(const Triangle3d& screenTri);
+	// Shaded pixels are batched and converted to sRGB together
+	std::vector<Vector2i> mPixelBatch;
+	std::vector<Vector3d> mColorBatch;
+	std::vector<uint32_t> mPackedBatch;
 	
-	void getRasterRegion(Box2i& region, const Triangle3d& screenTri);
+	void rasterPixel(int x, int y, const Vector3d& color);
+	void flushPixels();
 	
-	void raster(const Box2i& region, const Triangle3d& screenTri, const Triangle3d& triangle);
-	void rasterPixel(ShaderInput& input);
+	int getShadingRate(int tileX, int tileY) const;
 };
 
 #endif
\ No newline at end of file
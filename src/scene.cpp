@@ -0,0 +1,232 @@
+#include "scene.h"
+#include <algorithm>
+
+Scene::Scene() :
+	mRoot(-1),
+	mNeedsBuild(false)
+{
+}
+
+Scene::TObjectId Scene::add(const Mesh& mesh, const Transform& transform, double scale, TObjectId parent)
+{
+	SceneObject object;
+	object.mesh = &mesh;
+	object.scale = scale;
+	object.lod = nullptr;
+	object.lodLevel = 0;
+	
+	// Matrix and bounds are set by the next update
+	mObjects.push_back(object);
+	mHierarchy.add(transform, parent);
+	mNeedsBuild = true;
+	return (TObjectId)mObjects.size() - 1;
+}
+
+Scene::TObjectId Scene::add(const MeshLod& lod, const Transform& transform, double scale, TObjectId parent)
+{
+	TObjectId id = add(lod.getLevel(0), transform, scale, parent);
+	mObjects[id].lod = &lod;
+	mObjects[id].lodLevel = -1;
+	return id;
+}
+
+const Mesh& Scene::selectLod(TObjectId id, double screenSize)
+{
+	SceneObject& object = mObjects[id];
+	if (!object.lod)
+	{
+		return *object.mesh;
+	}
+	
+	object.lodLevel = object.lod->selectLevel(screenSize, object.lodLevel);
+	return object.lod->getLevel(object.lodLevel);
+}
+
+void Scene::setTransform(TObjectId id, const Transform& transform)
+{
+	mHierarchy.setLocal(id, transform);
+}
+
+void Scene::update()
+{
+	// Only the dirty subtrees of the hierarchy come back
+	mChanged.clear();
+	mHierarchy.update(mChanged);
+	
+	for (TObjectId id : mChanged)
+	{
+		SceneObject& object = mObjects[id];
+		object.matrix = mHierarchy.getWorldMatrix(id) * Matrix4d::createScale(object.scale, object.scale, object.scale);
+		object.bounds = object.mesh->bounds.transformed(object.matrix);
+		
+		if (!mNeedsBuild)
+		{
+			refit(id);
+		}
+	}
+	
+	if (mNeedsBuild)
+	{
+		buildTree();
+	}
+}
+
+void Scene::refit(TObjectId id)
+{
+	// From the leaf up, until a node no longer changes
+	int node = mLeaves[id];
+	mNodes[node].bounds = mObjects[id].bounds;
+	
+	for (node = mNodes[node].parent; node >= 0; node = mNodes[node].parent)
+	{
+		Node& parent = mNodes[node];
+		Aabb3d bounds = mNodes[parent.left].bounds | mNodes[parent.right].bounds;
+		if (bounds == parent.bounds)
+		{
+			break;
+		}
+		parent.bounds = bounds;
+	}
+}
+
+void Scene::build()
+{
+	mNeedsBuild = true;
+	update();
+}
+
+void Scene::buildTree()
+{
+	mNodes.clear();
+	mNodes.reserve(mObjects.size() * 2);
+	mLeaves.resize(mObjects.size());
+	
+	std::vector<TObjectId> objects(mObjects.size());
+	for (size_t i = 0; i < objects.size(); i++)
+	{
+		objects[i] = (TObjectId)i;
+	}
+	
+	mRoot = objects.empty() ? -1 : buildNode(objects, 0, (int)objects.size(), -1);
+	mNeedsBuild = false;
+}
+
+int Scene::buildNode(std::vector<TObjectId>& objects, int begin, int end, int parent)
+{
+	int index = (int)mNodes.size();
+	mNodes.push_back(Node());
+	mNodes[index].parent = parent;
+	mNodes[index].left = -1;
+	mNodes[index].right = -1;
+	mNodes[index].object = -1;
+	
+	if (end - begin == 1)
+	{
+		TObjectId id = objects[begin];
+		mNodes[index].bounds = mObjects[id].bounds;
+		mNodes[index].object = id;
+		mLeaves[id] = index;
+		return index;
+	}
+	
+	// Median split along the longest axis of the object centers
+	Aabb3d centers;
+	for (int i = begin; i < end; i++)
+	{
+		centers << mObjects[objects[i]].bounds.center();
+	}
+	
+	Vector3d size = centers.size();
+	int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+	
+	int mid = (begin + end) / 2;
+	std::nth_element(objects.begin() + begin, objects.begin() + mid, objects.begin() + end,
+		[this, axis](TObjectId a, TObjectId b)
+		{
+			return mObjects[a].bounds.center()[axis] < mObjects[b].bounds.center()[axis];
+		});
+	
+	int left = buildNode(objects, begin, mid, index);
+	int right = buildNode(objects, mid, end, index);
+	
+	mNodes[index].left = left;
+	mNodes[index].right = right;
+	mNodes[index].bounds = mNodes[left].bounds | mNodes[right].bounds;
+	return index;
+}
+
+void Scene::cull(const Frustum& frustum, std::vector<TObjectId>& visible)
+{
+	update();
+	
+	if (mRoot < 0)
+	{
+		return;
+	}
+	
+	std::vector<int> stack(1, mRoot);
+	while (!stack.empty())
+	{
+		int index = stack.back();
+		stack.pop_back();
+		
+		const Node& node = mNodes[index];
+		Frustum::Containment containment = frustum.classify(node.bounds);
+		if (containment == Frustum::Containment::Outside)
+		{
+			continue;
+		}
+		
+		if (containment == Frustum::Containment::Inside || node.left < 0)
+		{
+			collect(index, visible);
+			continue;
+		}
+		
+		stack.push_back(node.left);
+		stack.push_back(node.right);
+	}
+}
+
+void Scene::query(const Vector3d& center, double radius, std::vector<TObjectId>& result)
+{
+	update();
+	
+	if (mRoot < 0)
+	{
+		return;
+	}
+	
+	std::vector<int> stack(1, mRoot);
+	while (!stack.empty())
+	{
+		const Node& node = mNodes[stack.back()];
+		stack.pop_back();
+		
+		if (!math::intersects(node.bounds, center, radius))
+		{
+			continue;
+		}
+		
+		if (node.left < 0)
+		{
+			result.push_back(node.object);
+			continue;
+		}
+		
+		stack.push_back(node.left);
+		stack.push_back(node.right);
+	}
+}
+
+void Scene::collect(int node, std::vector<TObjectId>& result) const
+{
+	if (mNodes[node].left < 0)
+	{
+		result.push_back(mNodes[node].object);
+		return;
+	}
+	
+	collect(mNodes[node].left, result);
+	collect(mNodes[node].right, result);
+}
@@ -0,0 +1,119 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <vector>
+
+#include "math/vmath.h"
+#include "geometry/frustum.h"
+#include "geometry/hierarchy.h"
+#include "geometry/transform.h"
+#include "mesh.h"
+#include "meshlod.h"
+
+struct SceneObject
+{
+	const Mesh* mesh;
+	double scale;
+	
+	// Optional detail levels, mesh is their level 0
+	const MeshLod* lod;
+	int lodLevel;
+	
+	// Global space, kept up to date by the scene
+	Aabb3d bounds;
+	
+	// World matrix of the object's node times the scale, which is not
+	// inherited by children
+	Matrix4d matrix;
+	
+	// Mesh of the level selected last, the full mesh until one is
+	const Mesh& getMesh() const
+	{
+		return lod && lodLevel >= 0 ? lod->getLevel(lodLevel) : *mesh;
+	}
+	
+	// Same as: parent world * T * R * S
+	const Matrix4d& getMatrix() const
+	{
+		return matrix;
+	}
+};
+
+// Objects kept in a bounding volume hierarchy over their global bounds.
+// Each object is the node of the same id in a transform hierarchy, so
+// objects can be attached to others and move with them. Moving an object
+// refits the BVH nodes above it and its children, the tree is only rebuilt
+// when objects are added (or on request).
+class Scene
+{
+public:
+	using TObjectId = int;
+	
+	Scene();
+	
+	// The mesh must outlive the scene. transform is relative to parent,
+	// which must already exist, or global for -1.
+	TObjectId add(const Mesh& mesh, const Transform& transform, double scale = 1.0, TObjectId parent = -1);
+	
+	// Same, drawn with the level of lod picked by selectLod
+	TObjectId add(const MeshLod& lod, const Transform& transform, double scale = 1.0, TObjectId parent = -1);
+	
+	// Relative to the parent, applied by the next update
+	void setTransform(TObjectId id, const Transform& transform);
+	const Transform& getTransform(TObjectId id) const { return mHierarchy.getLocal(id); }
+	
+	// Recompute the world matrices of moved objects and their children,
+	// and refit the bounds of only those. cull and query update first.
+	void update();
+	
+	// Mesh to draw the object with, given its projected size in pixels.
+	// Objects without levels always return their mesh.
+	const Mesh& selectLod(TObjectId id, double screenSize);
+	
+	const SceneObject& getObject(TObjectId id) const { return mObjects[id]; }
+	int getObjectCount() const { return (int)mObjects.size(); }
+	
+	// Rebuild the BVH from scratch. Refitting keeps culling correct
+	// but the tree degrades if objects move far from where they were built.
+	void build();
+	
+	// Collect objects overlapping the frustum. Subtrees completely inside
+	// or outside are accepted or rejected without testing their children.
+	void cull(const Frustum& frustum, std::vector<TObjectId>& visible);
+	
+	// Collect objects overlapping the sphere, e.g. the range of a light
+	void query(const Vector3d& center, double radius, std::vector<TObjectId>& result);
+	
+private:
+	struct Node
+	{
+		Aabb3d bounds;
+		int parent;
+		
+		// Children, or -1 for leaves
+		int left, right;
+		
+		// Object of leaf nodes
+		TObjectId object;
+	};
+	
+	std::vector<SceneObject> mObjects;
+	TransformHierarchy mHierarchy;
+	std::vector<Node> mNodes;
+	
+	// Leaf node of each object
+	std::vector<int> mLeaves;
+	
+	int mRoot;
+	bool mNeedsBuild;
+	
+	// Objects whose world matrix changed in the last update
+	std::vector<TObjectId> mChanged;
+	
+	void buildTree();
+	int buildNode(std::vector<TObjectId>& objects, int begin, int end, int parent);
+	void collect(int node, std::vector<TObjectId>& result) const;
+	void refit(TObjectId id);
+};
+
+#endif
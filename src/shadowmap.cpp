@@ -0,0 +1,101 @@
+#include "shadowmap.h"
+#include <algorithm>
+
+namespace
+{
+	// Limits the slope bias at grazing angles, where the surface is
+	// (nearly) unlit anyway
+	const double xcMaxSlope = 8.0;
+}
+
+ShadowMap::ShadowMap(int width, int height, double fovY, double near, double far) :
+	mWidth(width),
+	mHeight(height),
+	mBias(0.5),
+	mSlopeBias(2.0),
+	mTexelScale(2.0 * std::tan(fovY / 360.0 * M_PI) / height),
+	mFrustum(fovY, width / (double)height, near, far),
+	mViewport(width, height),
+	mDepth(width * height)
+{
+	clear();
+}
+
+void ShadowMap::lookAt(const Vector3d& pos, const Vector3d& target)
+{
+	// The frustum looks down its local negative z-axis
+	constexpr Vector3d forward(0.0, 0.0, -1.0);
+
+	Vector3d dir = target - pos;
+	dir.normalize();
+
+	Vector3d axis = forward.crossProduct(dir);
+	double cosAngle = std::max(-1.0, std::min(1.0, forward.dotProduct(dir)));
+
+	Quatd rot(1.0, 0.0, 0.0, 0.0);
+	if (axis.lengthSq() > 1e-12)
+	{
+		axis.normalize();
+		rot = Quatd::fromAxisRot(axis, std::acos(cosAngle) * 180.0 / M_PI);
+	}
+	else if (cosAngle < 0.0)
+	{
+		// Looking straight back, any perpendicular axis will do
+		rot = Quatd::fromAxisRot(Vector3d(0.0, 1.0, 0.0), 180.0);
+	}
+
+	mFrustum.getTransform().setPosition(pos);
+	mFrustum.getTransform().setRotation(rot);
+}
+
+void ShadowMap::clear()
+{
+	std::fill(mDepth.begin(), mDepth.end(), (float)mViewport.getDepthFar());
+}
+
+double ShadowMap::lookup(const Vector3r& p, double cosAngle) const
+{
+	// Moving p toward the light keeps its texel, and offsets its linear
+	// depth by the bias at any distance. A bias on the stored depth would
+	// grow with the square of the distance.
+	const Vector3d toLight = mFrustum.getTransform().getPosition() - Vector3d(p);
+	const double dist = toLight.length();
+
+	// The depth of a sloped surface changes by texel size * tan across a
+	// texel, and the kernel reaches one texel out
+	cosAngle = std::max(cosAngle, 1.0 / xcMaxSlope);
+	const double slope = std::min(std::sqrt(1.0 - cosAngle * cosAngle) / cosAngle, xcMaxSlope);
+	const double bias = mBias + mSlopeBias * mTexelScale * dist * slope;
+	const Vector3r biased = dist > bias ? Vector3r(Vector3d(p) + toLight * (bias / dist)) : p;
+
+	Vector3r ndc;
+	mFrustum.project(&biased, &ndc, 1);
+	if (!Frustum::ndcContained(ndc, 0.0))
+	{
+		// Outside of the light frustum, treat as lit
+		return 1.0;
+	}
+
+	ndc.y = -ndc.y;
+	Vector3r screen = mFrustum.ndcToViewportSpace(ndc, mViewport);
+	double depth = screen.z;
+
+	const int cx = (int)screen.x;
+	const int cy = (int)screen.y;
+
+	int lit = 0;
+	for (int dy = -1; dy <= 1; dy++)
+	{
+		const int y = std::max(0, std::min(mHeight - 1, cy + dy));
+		for (int dx = -1; dx <= 1; dx++)
+		{
+			const int x = std::max(0, std::min(mWidth - 1, cx + dx));
+			if (depth <= depthAt(x, y))
+			{
+				lit++;
+			}
+		}
+	}
+
+	return lit / 9.0;
+}
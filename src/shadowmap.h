@@ -0,0 +1,61 @@
+#ifndef SHADOWMAP_H
+#define SHADOWMAP_H
+
+#include <vector>
+
+#include "math/vmath.h"
+#include "geometry/frustum.h"
+#include "geometry/viewport.h"
+
+// Depth map rendered from the point of view of a light.
+// Filled by Renderer::renderShadowTriangle, sampled by the shaders.
+class ShadowMap
+{
+public:
+	ShadowMap(int width, int height, double fovY, double near, double far);
+
+	// Place the light frustum at pos, looking at target
+	void lookAt(const Vector3d& pos, const Vector3d& target);
+
+	Frustum& getFrustum() { return mFrustum; }
+	const Frustum& getFrustum() const { return mFrustum; }
+	const Viewport& getViewport() const { return mViewport; }
+
+	int getWidth() const { return mWidth; }
+	int getHeight() const { return mHeight; }
+
+	// Distance in world units that points are moved toward the light
+	// before comparing against the map, fights shadow acne
+	void setBias(double bias) { mBias = bias; }
+	double getBias() const { return mBias; }
+
+	// Added to the bias in shadow map texels (at the point's distance),
+	// times the tangent of the angle between surface normal and light
+	void setSlopeBias(double texels) { mSlopeBias = texels; }
+	double getSlopeBias() const { return mSlopeBias; }
+
+	void clear();
+
+	float& depthAt(int x, int y) { return mDepth[y * mWidth + x]; }
+	float depthAt(int x, int y) const { return mDepth[y * mWidth + x]; }
+
+	// Percentage closer filtering of point p (in global space). cosAngle
+	// is between the surface normal and the direction to the light.
+	// Returns the lit fraction [0, 1] of a 3x3 sample kernel.
+	double lookup(const Vector3r& p, double cosAngle = 1.0) const;
+
+private:
+	int mWidth, mHeight;
+	double mBias;
+	double mSlopeBias;
+
+	// World size of a texel at distance 1 from the light
+	double mTexelScale;
+
+	Frustum mFrustum;
+	Viewport mViewport;
+
+	std::vector<float> mDepth;
+};
+
+#endif